@@ -0,0 +1,300 @@
+/*
+SudMon - Seneye USB Device Monitor
+Copyright (C) 2018  Bernat Arlandis (berarma@hotmail.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <errno.h>
+#include <map>
+#include <netinet/in.h>
+#include <queue>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+#include "io.hpp"
+#include "wire.hpp"
+#include "ProjectConfig.h"
+
+#define DEFAULT_PORT 7474
+#define DEFAULT_WINDOW 5
+#define MAX_EVENTS 64
+#define MAX_PENDING 65536
+#define BUFFER_SIZE 8192
+
+typedef struct {
+    int fd;
+    unsigned char buffer[BUFFER_SIZE];
+    size_t size;
+    std::string stream;
+    std::string host;
+    std::string serial;
+    uint32_t received;
+    uint32_t acked;
+} Connection;
+
+typedef struct {
+    double time;
+    uint64_t order;
+    std::string host;
+    std::string serial;
+    SudData data;
+} Record;
+
+struct RecordCompare {
+    bool operator()(const Record &a, const Record &b) const {
+        if (a.time != b.time) {
+            return a.time > b.time;
+        }
+        return a.order > b.order;
+    }
+};
+
+static std::priority_queue<Record, std::vector<Record>, RecordCompare> pending;
+static std::map<std::string, uint32_t> lastSeq;
+static uint64_t order = 0;
+
+static double wallTime() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void printUsage() {
+    printf("%s collector v%d.%d.%d, Copyright (C) 2018 Bernat Arlandis\n", PROJECT_NAME, PROJECT_VERSION_MAJOR, PROJECT_VERSION_MINOR, PROJECT_VERSION_PATCH);
+    printf("\n");
+    printf("Merges the readings streamed by sudmon -N into a single feed ordered by time.\n");
+    printf("\n");
+    printf("Available options:\n");
+    printf("  -h This help\n");
+    printf("  -p <port> Listen port (default %d)\n", DEFAULT_PORT);
+    printf("  -w <seconds> Reorder window (default %d)\n", DEFAULT_WINDOW);
+    printf("  -F Use Farenheit units (default is Celsius)\n");
+    printf("  -t Convert timestamp to date/time\n");
+    printf("\n");
+}
+
+static void emit(double until, const Options *options) {
+    bool printed = false;
+
+    while (!pending.empty() && (pending.top().time <= until || pending.size() > MAX_PENDING)) {
+        const Record &record = pending.top();
+        printf("%s %s ", record.host.c_str(), record.serial.c_str());
+        printReading(&record.data, options);
+        pending.pop();
+        printed = true;
+    }
+
+    if (printed) {
+        fflush(stdout);
+    }
+}
+
+/*
+ * Handles all complete frames in the connection buffer. Returns false when
+ * the connection must be closed.
+ */
+static bool process(Connection *conn) {
+    WireMessage message;
+    size_t offset = 0;
+    int res;
+
+    while ((res = wireDecode(conn->buffer + offset, conn->size - offset, &message)) > 0) {
+        offset += res;
+
+        switch (message.type) {
+            case WIRE_HELLO:
+                {
+                    char session[16];
+                    snprintf(session, sizeof(session), "%08x", message.session);
+                    conn->host = message.host;
+                    conn->serial = message.serial;
+                    conn->stream = conn->host + "/" + conn->serial + "/" + session;
+                }
+                break;
+            case WIRE_READING:
+                {
+                    if (conn->stream.empty()) {
+                        return false;
+                    }
+
+                    conn->received = message.seq;
+
+                    uint32_t &last = lastSeq[conn->stream];
+                    if (message.seq <= last) {
+                        break;
+                    }
+                    last = message.seq;
+
+                    Record record;
+                    record.time = message.time;
+                    record.order = order++;
+                    record.host = conn->host;
+                    record.serial = conn->serial;
+                    record.data = message.data;
+                    pending.push(record);
+                }
+                break;
+            default:
+                return false;
+        }
+    }
+
+    if (res < 0) {
+        return false;
+    }
+
+    memmove(conn->buffer, conn->buffer + offset, conn->size - offset);
+    conn->size -= offset;
+
+    if (conn->received != conn->acked) {
+        unsigned char ack[WIRE_ACK_SIZE];
+        wireAck(ack, conn->received);
+        if (send(conn->fd, ack, sizeof(ack), MSG_NOSIGNAL | MSG_DONTWAIT) == sizeof(ack)) {
+            conn->acked = conn->received;
+        }
+    }
+
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    int port = DEFAULT_PORT;
+    int window = DEFAULT_WINDOW;
+    int c;
+
+    memset(&options, 0, sizeof(options));
+    options.machineReadable = true;
+
+    while ((c = getopt(argc, argv, "hp:w:Ft")) != -1) {
+        switch (c) {
+            case 'h':
+                printUsage();
+                return 0;
+            case 'p':
+                port = (int)strtol(optarg, NULL, 10);
+                break;
+            case 'w':
+                window = (int)strtol(optarg, NULL, 10);
+                break;
+            case 'F':
+                options.farenheit = true;
+                break;
+            case 't':
+                options.humanizeTs = true;
+                break;
+            default:
+                return 1;
+        }
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    int listener = socket(AF_INET6, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listener < 0) {
+        fprintf(stderr, "Unable to create socket.\n");
+
+        return -1;
+    }
+
+    int on = 1, off = 0;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    setsockopt(listener, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+
+    struct sockaddr_in6 addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin6_family = AF_INET6;
+    addr.sin6_addr = in6addr_any;
+    addr.sin6_port = htons(port);
+    if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(listener, 64) != 0) {
+        fprintf(stderr, "Unable to listen on port %d.\n", port);
+
+        return -1;
+    }
+
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event event, events[MAX_EVENTS];
+    event.events = EPOLLIN;
+    event.data.ptr = NULL;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, listener, &event);
+
+    while (1) {
+        int timeout = -1;
+        if (!pending.empty()) {
+            double wait = pending.top().time + window - wallTime();
+            timeout = wait > 0 ? (int)(wait * 1000) + 1 : 0;
+        }
+
+        int n = epoll_wait(epfd, events, MAX_EVENTS, timeout);
+        if (n < 0 && errno != EINTR) {
+            fprintf(stderr, "Error waiting for connections.\n");
+
+            return -1;
+        }
+
+        for (int i = 0; i < n; i++) {
+            Connection *conn = (Connection *)events[i].data.ptr;
+
+            if (conn == NULL) {
+                int fd;
+                while ((fd = accept4(listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                    conn = new Connection();
+                    conn->fd = fd;
+                    conn->size = 0;
+                    conn->received = 0;
+                    conn->acked = 0;
+                    event.events = EPOLLIN;
+                    event.data.ptr = conn;
+                    epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &event);
+                }
+                continue;
+            }
+
+            bool open = true;
+            ssize_t res;
+            while (open && (res = recv(conn->fd, conn->buffer + conn->size, BUFFER_SIZE - conn->size, 0)) != 0) {
+                if (res < 0) {
+                    open = errno == EAGAIN || errno == EWOULDBLOCK;
+                    break;
+                }
+                conn->size += res;
+                open = process(conn);
+            }
+            if (res == 0) {
+                open = false;
+            }
+
+            if (!open) {
+                epoll_ctl(epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+                close(conn->fd);
+                delete conn;
+            }
+        }
+
+        emit(wallTime() - window, &options);
+    }
+
+    return 0;
+}
@@ -17,11 +17,13 @@ along with this program; if not, write to the Free Software
 Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 */
 
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <iostream>
+#include <string.h>
 #include <unistd.h>
 #include <sys/time.h>
+#include <time.h>
 #include <hidapi/hidapi.h>
 #include "io.hpp"
 #include "sud.hpp"
@@ -42,14 +44,26 @@ void printHelp() {
     printf("\n");
     printf("Available modifiers (optional):\n");
     printf("  -d Debug mode\n");
+    printf("  -M Report start-up time and memory usage to stderr at the first reading\n");
+    printf("  -T <path> Write flight recorder dumps to <path>.N (default is stderr as hex)\n");
     printf("  -i <path> or <serial number> Select device by path or serial number (defaults to first one)\n");
     printf("  -f Full readings (with temp, pH and NH3)\n");
     printf("  -F Use Farenheit units (default is Celsius)\n");
     printf("  -w <seconds> Wait time between reads (only for full readings)\n");
+    printf("  -a <min>,<max> Adapt wait time between full reads to sensor activity (seconds)\n");
+    printf("  -R <temp>,<ph>,<nh3> Rates of change per minute considered activity (default 0.05,0.02,0.005)\n");
+    printf("  -I <seconds> Print light summaries (DLI, photoperiod, spectrum) every X seconds and at day end\n");
     printf("  -H <rows> Display the header every X rows\n");
     printf("  -m Machine readable output\n");
     printf("  -t Convert timestamp to date/time\n");
-    printf("  -D Use device timestamp\n");
+    printf("  -L <path> Accept Led status updates on a datagram socket (continuous reading)\n");
+    printf("  -N <host:port> Stream readings to a collector (see sudcollect)\n");
+    printf("  -o <path> Write readings to a log file instead of stdout\n");
+    printf("  -O <kbytes>,<seconds> Rotate the log file by size and/or age (0 disables either)\n");
+    printf("  -z Compress the log file with gzip\n");
+    printf("  -S <path> Store readings in an SQLite database\n");
+    printf("  -p <name> Publish latest readings to shared memory segment <name>\n");
+    printf("  -D Use device clock (drift corrected) for timestamps\n");
     printf("\n");
 }
 
@@ -70,9 +84,24 @@ bool parseOpts(Options *options, int argc, char * const argv[]) {
     options->waitTime = 0;
     options->commands = 0;
     options->ident = NULL;
+    options->shmName = NULL;
+    options->ledSocket = NULL;
+    options->collector = NULL;
+    options->adaptiveBounds = NULL;
+    options->adaptiveRates = NULL;
+    options->dumpPath = NULL;
+    options->database = NULL;
+    options->logPath = NULL;
+    options->logRotation = NULL;
+    options->logCompress = false;
+    options->lightInterval = -1;
+    options->measure = false;
 
-    while ((c = getopt(argc, argv, "cdDfFhH:i:lmrs:tw:")) != -1) {
+    while ((c = getopt(argc, argv, "a:cdDfFhH:i:I:lL:mMN:o:O:p:rR:s:S:tT:w:z")) != -1) {
         switch (c) {
+            case 'a':
+                options->adaptiveBounds = optarg;
+                break;
             case 'c':
                 options->cmdContReading = true;
                 options->commands++;
@@ -98,28 +127,61 @@ bool parseOpts(Options *options, int argc, char * const argv[]) {
             case 'i':
                 options->ident = optarg;
                 break;
+            case 'I':
+                options->lightInterval = (int)strtol(optarg, NULL, 10);
+                break;
             case 'l':
                 options->cmdList = true;
                 options->commands++;
                 break;
+            case 'L':
+                options->ledSocket = optarg;
+                break;
             case 'm':
                 options->machineReadable = true;
                 break;
+            case 'M':
+                options->measure = true;
+                break;
+            case 'N':
+                options->collector = optarg;
+                break;
+            case 'o':
+                options->logPath = optarg;
+                break;
+            case 'O':
+                options->logRotation = optarg;
+                break;
+            case 'p':
+                options->shmName = optarg;
+                break;
             case 'r':
                 options->cmdReading = true;
                 options->commands++;
                 break;
+            case 'R':
+                options->adaptiveRates = optarg;
+                break;
             case 's':
                 options->cmdSetLeds = true;
                 options->leds = optarg;
                 options->commands++;
                 break;
+            case 'S':
+                options->database = optarg;
+                break;
             case 't':
                 options->humanizeTs = true;
                 break;
+            case 'T':
+                options->dumpPath = optarg;
+                break;
             case 'w':
                 options->waitTime = (int)strtol(optarg, NULL, 10);
                 break;
+            case 'z':
+                options->logCompress = true;
+                break;
             case '?':
                 if (optopt == 'c') {
                     fprintf(stderr, "Option -%c requires an argument.\n", optopt);
@@ -161,13 +223,36 @@ void printDeviceInfo(const hid_device_info *device, const SudData *data) {
           );
 }
 
+void formatTimestamp(char *timestamp, size_t size, double ts, const Options *options) {
+    if (options->humanizeTs) {
+        time_t secs = (time_t)ts;
+        struct tm timeinfo;
+        localtime_r(&secs, &timeinfo);
+        strftime(timestamp, size, "%F %T", &timeinfo);
+    } else {
+        snprintf(timestamp, size, "%.3f", ts);
+    }
+}
+
+const char *getHeader() {
+    return
+        "==========================================================================================\n"
+        "| Timestamp          | Wet | Temp.  | Slide  | pH   | NH3   | Kelvin | PAR  | Lux  | PUR |\n"
+        "------------------------------------------------------------------------------------------\n";
+}
+
 void printHeader() {
-    printf("==========================================================================================\n");
-    printf("| Timestamp          | Wet | Temp.  | Slide  | pH   | NH3   | Kelvin | PAR  | Lux  | PUR |\n");
-    printf("------------------------------------------------------------------------------------------\n");
+    fputs(getHeader(), stdout);
 }
 
 void printReading(const SudData *data, const Options *options) {
+    char line[READING_LINE_SIZE];
+
+    formatReading(line, sizeof(line), data, options);
+    fputs(line, stdout);
+}
+
+int formatReading(char *line, size_t size, const SudData *data, const Options *options) {
     char
         timestamp[20],
         inWater[20],
@@ -180,12 +265,9 @@ void printReading(const SudData *data, const Options *options) {
         lux[20],
         pur[20];
 
-    time_t ts;
+    double ts = options->useDevTs ? data->deviceTime : data->hostTime;
 
     if (data->fullReading) {
-        if (options->useDevTs) {
-            ts = data->timestamp;
-        }
         snprintf(inWater, 20, "%s",data->inWater ? "Yes" : "No");
         if (options->farenheit) {
             snprintf(temp, 20, "%.3f", ((double)data->temp / 1000) * 1.8 + 32);
@@ -216,10 +298,6 @@ void printReading(const SudData *data, const Options *options) {
         snprintf(nh3, 20, "-");
     }
 
-    if (!data->fullReading || !options->useDevTs) {
-        ts = time(NULL);
-    }
-
     if (data->isKelvin) {
         snprintf(kelvin, 20, "%u", data->kelvin / 1000);
     } else {
@@ -229,16 +307,10 @@ void printReading(const SudData *data, const Options *options) {
     snprintf(lux, 20, "%d", data->lux);
     snprintf(pur, 20, "%d%%", data->pur);
 
-    if (options->humanizeTs) {
-        struct tm *timeinfo;
-        timeinfo = localtime(&ts);
-        strftime(timestamp, 20, "%F %T", timeinfo);
-    } else {
-        snprintf(timestamp, 20, "%ld", ts);
-    }
+    formatTimestamp(timestamp, 20, ts, options);
 
     if (options->machineReadable) {
-        printf("%s %s %s %s %s %s %s %s %s %s\n",
+        return snprintf(line, size, "%s %s %s %s %s %s %s %s %s %s\n",
                 timestamp,
                 inWater,
                 temp,
@@ -251,7 +323,7 @@ void printReading(const SudData *data, const Options *options) {
                 pur
               );
     } else {
-        printf("|%19s | %-4s|%7s | %-7s|%5s |%6s |%7s |%5s |%5s |%4s |\n",
+        return snprintf(line, size, "|%19s | %-4s|%7s | %-7s|%5s |%6s |%7s |%5s |%5s |%4s |\n",
                 timestamp,
                 inWater,
                 temp,
@@ -266,6 +338,112 @@ void printReading(const SudData *data, const Options *options) {
     }
 }
 
+void printLightEvent(double ts, bool on, const Options *options) {
+    char line[READING_LINE_SIZE];
+
+    formatLightEvent(line, sizeof(line), ts, on, options);
+    fputs(line, stdout);
+}
+
+int formatLightEvent(char *line, size_t size, double ts, bool on, const Options *options) {
+    char timestamp[20];
+
+    formatTimestamp(timestamp, 20, ts, options);
+    if (options->machineReadable) {
+        return snprintf(line, size, "LIGHT %s %s\n", timestamp, on ? "on" : "off");
+    }
+
+    return snprintf(line, size, "Lights %s at %s\n", on ? "on" : "off", timestamp);
+}
+
+void printLightSummary(const LightSummary *summary, const Options *options) {
+    char line[READING_LINE_SIZE];
+
+    formatLightSummary(line, sizeof(line), summary, options);
+    fputs(line, stdout);
+}
+
+int formatLightSummary(char *line, size_t size, const LightSummary *summary, const Options *options) {
+    char timestamp[20], day[20];
+    struct tm timeinfo;
+    double coverage = summary->elapsed > 0 ? summary->covered * 100 / summary->elapsed : 0;
+
+    formatTimestamp(timestamp, 20, summary->time, options);
+    localtime_r(&summary->day, &timeinfo);
+    strftime(day, 20, "%F", &timeinfo);
+
+    if (options->machineReadable) {
+        return snprintf(line, size, "SUMMARY %s %s %.3f %.2f %.0f %.0f %.0f %.1f %s\n",
+                timestamp,
+                day,
+                summary->dli,
+                summary->photoperiod / 3600,
+                summary->kelvin,
+                summary->x,
+                summary->y,
+                coverage,
+                summary->final ? "final" : "partial"
+              );
+    }
+
+    return snprintf(line, size, "Light summary at %s for %s%s: DLI %.3f mol/m2, photoperiod %.2f h, %.0f K, x %.0f, y %.0f, coverage %.1f%%\n",
+            timestamp,
+            day,
+            summary->final ? " (final)" : "",
+            summary->dli,
+            summary->photoperiod / 3600,
+            summary->kelvin,
+            summary->x,
+            summary->y,
+            coverage
+          );
+}
+
+double getProcessAge() {
+    char buffer[1024];
+    unsigned long long start;
+    struct timespec now;
+    FILE *stat = fopen("/proc/self/stat", "r");
+
+    if (stat == NULL) {
+        return -1;
+    }
+    size_t size = fread(buffer, 1, sizeof(buffer) - 1, stat);
+    fclose(stat);
+    buffer[size] = '\0';
+
+    // The start time is the 22nd field, in clock ticks since boot. The name
+    // in the 2nd field may contain spaces, so count from its closing paren.
+    char *p = strrchr(buffer, ')');
+    if (p == NULL || sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %*u %*u %*d %*d %*d %*d %*d %*d %llu", &start) != 1) {
+        return -1;
+    }
+
+    clock_gettime(CLOCK_BOOTTIME, &now);
+
+    return now.tv_sec + now.tv_nsec / 1e9 - (double)start / sysconf(_SC_CLK_TCK);
+}
+
+void printMeasurement() {
+    char line[128];
+    long rss = -1, peak = -1;
+    double age = getProcessAge();
+    FILE *status = fopen("/proc/self/status", "r");
+
+    if (status != NULL) {
+        while (fgets(line, sizeof(line), status) != NULL) {
+            if (strncmp(line, "VmRSS:", 6) == 0) {
+                rss = strtol(line + 6, NULL, 10);
+            } else if (strncmp(line, "VmHWM:", 6) == 0) {
+                peak = strtol(line + 6, NULL, 10);
+            }
+        }
+        fclose(status);
+    }
+
+    fprintf(stderr, "First reading %.0f ms after process start, RSS %ld kB, peak RSS %ld kB\n", age * 1000, rss, peak);
+}
+
 void hexDump(const unsigned char *data, size_t size) {
     char ascii[17];
     size_t i, j;
@@ -20,10 +20,13 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include <ctime>
 #include <hidapi/hidapi.h>
 #include "sud.hpp"
+#include "light.hpp"
 
 #ifndef SUD_IO_HPP
 #define SUD_IO_HPP
 
+#define READING_LINE_SIZE 256
+
 typedef struct {
     bool debug;
     bool fullReadings;
@@ -37,17 +40,38 @@ typedef struct {
     bool cmdSetLeds;
     int headerRows;
     int waitTime;
+    int lightInterval;
     int commands;
     char *ident;
     char *leds;
+    char *shmName;
+    char *ledSocket;
+    char *collector;
+    char *adaptiveBounds;
+    char *adaptiveRates;
+    char *dumpPath;
+    char *database;
+    char *logPath;
+    char *logRotation;
+    bool logCompress;
+    bool measure;
 } Options;
 
 void printHelp();
 bool parseOpts(Options *options, int argc, char * const argv[]);
 void printDeviceList(const hid_device_info *devices);
 void printDeviceInfo(const hid_device_info *device, const SudData *data);
+const char *getHeader();
 void printHeader();
 void printReading(const SudData *data, const Options *options);
+int formatReading(char *line, size_t size, const SudData *data, const Options *options);
+void formatTimestamp(char *timestamp, size_t size, double ts, const Options *options);
+void printLightEvent(double ts, bool on, const Options *options);
+int formatLightEvent(char *line, size_t size, double ts, bool on, const Options *options);
+void printLightSummary(const LightSummary *summary, const Options *options);
+int formatLightSummary(char *line, size_t size, const LightSummary *summary, const Options *options);
+double getProcessAge();
+void printMeasurement();
 void hexDump(const unsigned char *data, size_t size);
 void debugSud(int direction, const unsigned char *buffer, size_t size);
 
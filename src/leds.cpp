@@ -0,0 +1,155 @@
+/*
+SudMon - Seneye USB Device Monitor
+Copyright (C) 2018  Bernat Arlandis (berarma@hotmail.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "leds.hpp"
+
+LedScheduler::LedScheduler() : fd(-1), path(NULL), hasPending(false), lastWrite(0)
+{
+    memset(pending, 0, sizeof(pending));
+    memset(current, 0, sizeof(current));
+}
+
+LedScheduler::~LedScheduler()
+{
+    close();
+}
+
+bool LedScheduler::open(const char *path)
+{
+    struct sockaddr_un addr;
+    struct stat st;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        return false;
+    }
+
+    // Only a stale socket is replaced, never another kind of file.
+    if (lstat(path, &st) == 0) {
+        if (!S_ISSOCK(st.st_mode) || unlink(path) != 0) {
+            return false;
+        }
+    } else if (errno != ENOENT) {
+        return false;
+    }
+
+    fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return false;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+
+    this->path = strdup(path);
+
+    return true;
+}
+
+void LedScheduler::close()
+{
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+
+    if (path != NULL) {
+        unlink(path);
+        free(path);
+        path = NULL;
+    }
+}
+
+void LedScheduler::poll()
+{
+    char message[64];
+    ssize_t size;
+
+    if (fd < 0) {
+        return;
+    }
+
+    while ((size = recv(fd, message, sizeof(message) - 1, 0)) >= 0) {
+        message[size] = '\0';
+        if (strspn(message, "0123456789") < 5) {
+            continue;
+        }
+        memcpy(pending, message, 5);
+        hasPending = memcmp(pending, current, 5) != 0;
+    }
+}
+
+bool LedScheduler::flush(SudController *sud)
+{
+    double now = SudClock::now();
+
+    if (!hasPending || now < lastWrite + LED_INTERVAL) {
+        return false;
+    }
+
+    lastWrite = now;
+    if (!sud->setLeds(pending)) {
+        return false;
+    }
+
+    hasPending = false;
+    memcpy(current, pending, 5);
+
+    return true;
+}
+
+void LedScheduler::wait(SudController *sud, double until, int wakeFd)
+{
+    double now;
+
+    while ((now = SudClock::now()) < until) {
+        poll();
+        flush(sud);
+
+        double wake = until;
+        if (hasPending && lastWrite + LED_INTERVAL < wake) {
+            wake = lastWrite + LED_INTERVAL;
+        }
+
+        struct pollfd pfd[2];
+        pfd[0].fd = fd;
+        pfd[0].events = POLLIN;
+        pfd[1].fd = wakeFd;
+        pfd[1].events = POLLOUT;
+        pfd[1].revents = 0;
+        int res = ::poll(pfd, 2, (int)((wake - now) * 1000) + 1);
+        if ((res < 0 && errno == EINTR) || pfd[1].revents != 0) {
+            return;
+        }
+    }
+}
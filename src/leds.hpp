@@ -0,0 +1,52 @@
+/*
+SudMon - Seneye USB Device Monitor
+Copyright (C) 2018  Bernat Arlandis (berarma@hotmail.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "sud.hpp"
+
+#ifndef SUD_LEDS_HPP
+#define SUD_LEDS_HPP
+
+#define LED_INTERVAL 1.0
+
+/*
+ * Receives LED states from local clients on a datagram socket and writes
+ * them to the device between sensor exchanges. Only the most recent state is
+ * kept and writes are spaced at least LED_INTERVAL seconds apart. wait()
+ * returns early when wakeFd becomes writable.
+ */
+class LedScheduler
+{
+    int fd;
+    char *path;
+    char pending[6];
+    char current[6];
+    bool hasPending;
+    double lastWrite;
+
+    public:
+        LedScheduler();
+        ~LedScheduler();
+        bool open(const char *path);
+        void close();
+        void poll();
+        bool flush(SudController *sud);
+        void wait(SudController *sud, double until, int wakeFd = -1);
+};
+
+#endif
@@ -0,0 +1,152 @@
+/*
+SudMon - Seneye USB Device Monitor
+Copyright (C) 2018  Bernat Arlandis (berarma@hotmail.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <string.h>
+#include "light.hpp"
+
+LightAccumulator::LightAccumulator() : interval(0), maxGap(LIGHT_MAX_GAP), lastTime(0), lastPar(0), lastEmit(0), hasLast(false), lightsOn(false)
+{
+    memset(&summary, 0, sizeof(summary));
+}
+
+void LightAccumulator::setInterval(double interval)
+{
+    this->interval = interval;
+}
+
+void LightAccumulator::setMaxGap(double maxGap)
+{
+    this->maxGap = maxGap;
+}
+
+int LightAccumulator::update(double time, const SudData *data)
+{
+    int events = 0;
+    double par = data->par;
+
+    if (data->mode != 0x00) {
+        return 0;
+    }
+
+    if (!hasLast) {
+        reset(time);
+        lastEmit = time;
+    } else if (time >= nextDay) {
+        double midnight = nextDay;
+        double parMidnight = lastPar + (par - lastPar) * (midnight - lastTime) / (time - lastTime);
+        bool joined = time - lastTime <= maxGap;
+
+        if (joined) {
+            accumulate(lastTime, lastPar, midnight, parMidnight, data);
+        }
+        fill(midnight, true);
+        events |= LIGHT_SUMMARY;
+        reset(joined ? midnight : time);
+        lastEmit = time;
+        if (joined) {
+            accumulate(midnight, parMidnight, time, par, data);
+        }
+    } else if (time > lastTime && time - lastTime <= maxGap) {
+        accumulate(lastTime, lastPar, time, par, data);
+    }
+
+    if (!lightsOn && par >= LIGHT_ON) {
+        lightsOn = true;
+        events |= LIGHT_TURNED_ON;
+    } else if (lightsOn && par < LIGHT_OFF) {
+        lightsOn = false;
+        events |= LIGHT_TURNED_OFF;
+    }
+
+    lastTime = time;
+    lastPar = par;
+    hasLast = true;
+
+    if (!(events & LIGHT_SUMMARY) && interval > 0 && time - lastEmit >= interval) {
+        fill(time, false);
+        events |= LIGHT_SUMMARY;
+        lastEmit = time;
+    } else if (!(events & LIGHT_SUMMARY) && (events & (LIGHT_TURNED_ON | LIGHT_TURNED_OFF))) {
+        fill(time, false);
+    }
+
+    return events;
+}
+
+const LightSummary *LightAccumulator::getSummary()
+{
+    return &summary;
+}
+
+void LightAccumulator::accumulate(double from, double parFrom, double to, double parTo, const SudData *data)
+{
+    double dt = to - from;
+
+    integral += (parFrom + parTo) / 2 * dt;
+    covered += dt;
+
+    if (lightsOn) {
+        photoperiod += dt;
+        if (data->isKelvin) {
+            kelvinSum += data->kelvin / 1000.0 * dt;
+            kelvinTime += dt;
+        }
+        xSum += data->x * dt;
+        ySum += data->y * dt;
+        spectrumTime += dt;
+    }
+}
+
+void LightAccumulator::fill(double time, bool final)
+{
+    summary.time = time;
+    summary.day = day;
+    summary.dli = integral / 1e6;
+    summary.photoperiod = photoperiod;
+    summary.covered = covered;
+    summary.elapsed = time - dayStart;
+    summary.kelvin = kelvinTime > 0 ? kelvinSum / kelvinTime : 0;
+    summary.x = spectrumTime > 0 ? xSum / spectrumTime : 0;
+    summary.y = spectrumTime > 0 ? ySum / spectrumTime : 0;
+    summary.lightsOn = lightsOn;
+    summary.final = final;
+}
+
+void LightAccumulator::reset(double time)
+{
+    time_t secs = (time_t)time;
+    struct tm timeinfo;
+
+    localtime_r(&secs, &timeinfo);
+    timeinfo.tm_hour = 0;
+    timeinfo.tm_min = 0;
+    timeinfo.tm_sec = 0;
+    timeinfo.tm_isdst = -1;
+    day = mktime(&timeinfo);
+    timeinfo.tm_mday++;
+    timeinfo.tm_isdst = -1;
+    nextDay = mktime(&timeinfo);
+
+    dayStart = time;
+    integral = 0;
+    photoperiod = 0;
+    covered = 0;
+    kelvinSum = kelvinTime = 0;
+    xSum = ySum = spectrumTime = 0;
+}
@@ -0,0 +1,90 @@
+/*
+SudMon - Seneye USB Device Monitor
+Copyright (C) 2018  Bernat Arlandis (berarma@hotmail.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <time.h>
+#include "sud.hpp"
+
+#ifndef SUD_LIGHT_HPP
+#define SUD_LIGHT_HPP
+
+#define LIGHT_MAX_GAP 300.0
+#define LIGHT_ON 10
+#define LIGHT_OFF 5
+
+#define LIGHT_SUMMARY 1
+#define LIGHT_TURNED_ON 2
+#define LIGHT_TURNED_OFF 4
+
+typedef struct {
+    double time;
+    time_t day;
+    double dli;
+    double photoperiod;
+    double covered;
+    double elapsed;
+    double kelvin;
+    double x;
+    double y;
+    bool lightsOn;
+    bool final;
+} LightSummary;
+
+/*
+ * Accumulates light metrics for the current local day: the daily light
+ * integral in mol/m2 from PAR, the time with lights on, and time weighted
+ * averages of colour temperature and CIE x/y while lights are on. Intervals
+ * between readings longer than the maximum gap (LIGHT_MAX_GAP seconds unless
+ * set) are not integrated.
+ */
+class LightAccumulator
+{
+    double interval;
+    double maxGap;
+    double lastTime;
+    double lastPar;
+    double lastEmit;
+    bool hasLast;
+    bool lightsOn;
+    time_t day;
+    time_t nextDay;
+    double integral;
+    double photoperiod;
+    double covered;
+    double dayStart;
+    double kelvinSum;
+    double kelvinTime;
+    double xSum;
+    double ySum;
+    double spectrumTime;
+    LightSummary summary;
+
+    public:
+        LightAccumulator();
+        void setInterval(double interval);
+        void setMaxGap(double maxGap);
+        int update(double time, const SudData *data);
+        const LightSummary *getSummary();
+
+    private:
+        void accumulate(double from, double parFrom, double to, double parTo, const SudData *data);
+        void fill(double time, bool final);
+        void reset(double time);
+};
+
+#endif
@@ -0,0 +1,373 @@
+/*
+SudMon - Seneye USB Device Monitor
+Copyright (C) 2018  Bernat Arlandis (berarma@hotmail.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "logfile.hpp"
+#include "ProjectConfig.h"
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+LogWriter::LogWriter() : options(NULL), path(NULL), maxSize(0), maxAge(0), compress(false), file(NULL), zstream(NULL),
+    written(0), opened(0), synced(0), dirty(false), rows(0), head(0), tail(0), lineHead(0), lineTail(0), stopping(false), dropped(0)
+{
+}
+
+LogWriter::~LogWriter()
+{
+    close();
+}
+
+bool LogWriter::open(const char *path, const char *rotation, bool compress, const Options *options)
+{
+    long size = 0;
+    double age = 0;
+
+    if (rotation != NULL && (sscanf(rotation, "%ld,%lf", &size, &age) < 1 || size < 0 || age < 0)) {
+        return false;
+    }
+
+#ifndef HAVE_ZLIB
+    if (compress) {
+        return false;
+    }
+#endif
+
+    this->path = strdup(path);
+    this->maxSize = size * 1024;
+    this->maxAge = age;
+    this->compress = compress;
+    this->options = options;
+
+    // A segment left by a previous run is rotated aside rather than appended
+    // to, a gzip stream can't be resumed.
+    char active[PATH_MAX];
+    struct stat st;
+    activePath(active, sizeof(active));
+    if (stat(active, &st) == 0 && st.st_size > 0) {
+        moveAside();
+    }
+
+    if (!openSegment()) {
+        free(this->path);
+        this->path = NULL;
+        return false;
+    }
+
+    sem_init(&pending, 0, 0);
+    stopping = false;
+    worker = std::thread(&LogWriter::run, this);
+
+    return true;
+}
+
+void LogWriter::close()
+{
+    if (worker.joinable()) {
+        stopping = true;
+        sem_post(&pending);
+        worker.join();
+        sem_destroy(&pending);
+    }
+
+    closeSegment();
+
+    if (dropped > 0) {
+        fprintf(stderr, "Log queue full, %lu records dropped.\n", dropped.load());
+        dropped = 0;
+    }
+
+    free(path);
+    path = NULL;
+}
+
+bool LogWriter::isOpen()
+{
+    return path != NULL;
+}
+
+void LogWriter::push(const SudData *data)
+{
+    size_t t = tail.load(std::memory_order_relaxed);
+
+    if (path == NULL || data->mode != 0x00) {
+        return;
+    }
+
+    if (t - head.load(std::memory_order_acquire) == LOG_QUEUE) {
+        dropped++;
+        return;
+    }
+
+    queue[t % LOG_QUEUE] = *data;
+    tail.store(t + 1, std::memory_order_release);
+    sem_post(&pending);
+}
+
+void LogWriter::pushLine(const char *text)
+{
+    size_t t = lineTail.load(std::memory_order_relaxed);
+
+    if (path == NULL) {
+        return;
+    }
+
+    if (t - lineHead.load(std::memory_order_acquire) == LOG_LINES) {
+        dropped++;
+        return;
+    }
+
+    LogLine *line = &lines[t % LOG_LINES];
+    line->after = tail.load(std::memory_order_relaxed);
+    strncpy(line->text, text, sizeof(line->text) - 1);
+    line->text[sizeof(line->text) - 1] = '\0';
+    lineTail.store(t + 1, std::memory_order_release);
+    sem_post(&pending);
+}
+
+void LogWriter::run()
+{
+    char line[READING_LINE_SIZE];
+
+    while (1) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += 1;
+        sem_timedwait(&pending, &deadline);
+
+        size_t h = head.load(std::memory_order_relaxed);
+        size_t lh = lineHead.load(std::memory_order_relaxed);
+        while (1) {
+            // Lines go after the readings that were queued before them.
+            if (lh != lineTail.load(std::memory_order_acquire) && lines[lh % LOG_LINES].after <= h) {
+                const char *text = lines[lh % LOG_LINES].text;
+                write(text, strlen(text));
+                lineHead.store(++lh, std::memory_order_release);
+                continue;
+            }
+
+            if (h == tail.load(std::memory_order_acquire)) {
+                break;
+            }
+
+            if (!options->machineReadable && (rows == 0 || (options->headerRows != 0 && rows % options->headerRows == 0))) {
+                const char *header = getHeader();
+                write(header, strlen(header));
+            }
+            rows++;
+
+            int size = formatReading(line, sizeof(line), &queue[h % LOG_QUEUE], options);
+            head.store(++h, std::memory_order_release);
+            if (size > 0) {
+                write(line, size < (int)sizeof(line) ? size : sizeof(line) - 1);
+            }
+
+            if (maxSize > 0 && written >= maxSize) {
+                rotate();
+            }
+        }
+
+        double now = SudClock::now();
+        if (maxAge > 0 && now - opened >= maxAge && rows > 0) {
+            rotate();
+        } else if (now - synced >= LOG_SYNC_INTERVAL) {
+            sync();
+        }
+
+        if (stopping && h == tail.load(std::memory_order_acquire) && lh == lineTail.load(std::memory_order_acquire)) {
+            break;
+        }
+    }
+}
+
+bool LogWriter::openSegment()
+{
+    char active[PATH_MAX];
+
+    activePath(active, sizeof(active));
+    file = fopen(active, "ab");
+    if (file == NULL) {
+        return false;
+    }
+
+    fseek(file, 0, SEEK_END);
+    written = ftell(file);
+    opened = synced = SudClock::now();
+    dirty = false;
+    rows = 0;
+
+#ifdef HAVE_ZLIB
+    if (compress) {
+        z_stream *stream = (z_stream *)calloc(1, sizeof(z_stream));
+        if (deflateInit2(stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            free(stream);
+            fclose(file);
+            file = NULL;
+            return false;
+        }
+        zstream = stream;
+    }
+#endif
+
+    return true;
+}
+
+void LogWriter::closeSegment()
+{
+    if (file == NULL) {
+        return;
+    }
+
+#ifdef HAVE_ZLIB
+    if (zstream != NULL) {
+        z_stream *stream = (z_stream *)zstream;
+        unsigned char out[4096];
+        int res;
+        stream->next_in = NULL;
+        stream->avail_in = 0;
+        do {
+            stream->next_out = out;
+            stream->avail_out = sizeof(out);
+            res = deflate(stream, Z_FINISH);
+            fwrite(out, 1, sizeof(out) - stream->avail_out, file);
+        } while (res == Z_OK);
+        deflateEnd(stream);
+        free(stream);
+        zstream = NULL;
+    }
+#endif
+
+    fflush(file);
+    fsync(fileno(file));
+    fclose(file);
+    file = NULL;
+}
+
+void LogWriter::rotate()
+{
+    closeSegment();
+    moveAside();
+
+    if (!openSegment()) {
+        fprintf(stderr, "Unable to open log file, readings will be dropped.\n");
+    }
+}
+
+void LogWriter::activePath(char *active, size_t size)
+{
+    snprintf(active, size, compress ? "%s.gz" : "%s", path);
+}
+
+void LogWriter::moveAside()
+{
+    char active[PATH_MAX], rotated[PATH_MAX], stamp[32];
+    time_t now = time(NULL);
+    struct tm timeinfo;
+
+    localtime_r(&now, &timeinfo);
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &timeinfo);
+    activePath(active, sizeof(active));
+
+    // Segments rotated within the same second get a counter, link() never
+    // replaces an existing file like rename() does.
+    for (int n = 1; n < 1000; n++) {
+        size_t length = strlen(stamp);
+        if (n > 1) {
+            snprintf(stamp + length, sizeof(stamp) - length, "-%d", n);
+        }
+        snprintf(rotated, sizeof(rotated), compress ? "%s.%s.gz" : "%s.%s", path, stamp);
+        stamp[length] = '\0';
+
+        if (link(active, rotated) == 0) {
+            unlink(active);
+            return;
+        }
+        if (errno != EEXIST) {
+            break;
+        }
+    }
+
+    fprintf(stderr, "Unable to rotate log file %s.\n", active);
+}
+
+void LogWriter::write(const char *text, size_t size)
+{
+    if (file == NULL) {
+        return;
+    }
+
+    dirty = true;
+
+#ifdef HAVE_ZLIB
+    if (zstream != NULL) {
+        z_stream *stream = (z_stream *)zstream;
+        unsigned char out[4096];
+        stream->next_in = (unsigned char *)text;
+        stream->avail_in = size;
+        do {
+            stream->next_out = out;
+            stream->avail_out = sizeof(out);
+            deflate(stream, Z_NO_FLUSH);
+            size_t produced = sizeof(out) - stream->avail_out;
+            fwrite(out, 1, produced, file);
+            written += produced;
+        } while (stream->avail_out == 0);
+        return;
+    }
+#endif
+
+    fwrite(text, 1, size, file);
+    written += size;
+}
+
+void LogWriter::sync()
+{
+    synced = SudClock::now();
+
+    if (file == NULL || !dirty) {
+        return;
+    }
+
+#ifdef HAVE_ZLIB
+    if (zstream != NULL) {
+        z_stream *stream = (z_stream *)zstream;
+        unsigned char out[4096];
+        stream->next_in = NULL;
+        stream->avail_in = 0;
+        do {
+            stream->next_out = out;
+            stream->avail_out = sizeof(out);
+            deflate(stream, Z_SYNC_FLUSH);
+            size_t produced = sizeof(out) - stream->avail_out;
+            fwrite(out, 1, produced, file);
+            written += produced;
+        } while (stream->avail_out == 0);
+    }
+#endif
+
+    fflush(file);
+    fsync(fileno(file));
+    dirty = false;
+}
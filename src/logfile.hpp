@@ -0,0 +1,96 @@
+/*
+SudMon - Seneye USB Device Monitor
+Copyright (C) 2018  Bernat Arlandis (berarma@hotmail.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <atomic>
+#include <semaphore.h>
+#include <stdio.h>
+#include <thread>
+#include "io.hpp"
+#include "sud.hpp"
+
+#ifndef SUD_LOGFILE_HPP
+#define SUD_LOGFILE_HPP
+
+#ifndef LOG_QUEUE
+#define LOG_QUEUE 1024
+#endif
+#ifndef LOG_LINES
+#define LOG_LINES 16
+#endif
+#define LOG_SYNC_INTERVAL 5.0
+
+typedef struct {
+    size_t after;
+    char text[READING_LINE_SIZE];
+} LogLine;
+
+/*
+ * Writes readings to a log file from a background thread. The reader loop
+ * hands readings over through a single producer, single consumer ring that
+ * never blocks. Other records, like light events, are passed as text lines
+ * in a smaller ring and written in order with the readings. The active segment is rotated when it grows past maxSize
+ * bytes or gets older than maxAge seconds, and can be gzip compressed while
+ * it is written. A segment found at start-up is rotated before writing.
+ */
+class LogWriter
+{
+    const Options *options;
+    char *path;
+    long maxSize;
+    double maxAge;
+    bool compress;
+    FILE *file;
+    void *zstream;
+    long written;
+    double opened;
+    double synced;
+    bool dirty;
+    unsigned long rows;
+    SudData queue[LOG_QUEUE];
+    std::atomic<size_t> head;
+    std::atomic<size_t> tail;
+    LogLine lines[LOG_LINES];
+    std::atomic<size_t> lineHead;
+    std::atomic<size_t> lineTail;
+    std::atomic<bool> stopping;
+    std::atomic<unsigned long> dropped;
+    sem_t pending;
+    std::thread worker;
+
+    public:
+        LogWriter();
+        ~LogWriter();
+        bool open(const char *path, const char *rotation, bool compress, const Options *options);
+        void close();
+        bool isOpen();
+        void push(const SudData *data);
+        void pushLine(const char *text);
+
+    private:
+        void run();
+        bool openSegment();
+        void closeSegment();
+        void rotate();
+        void activePath(char *active, size_t size);
+        void moveAside();
+        void write(const char *text, size_t size);
+        void sync();
+};
+
+#endif
@@ -17,28 +17,105 @@ along with this program; if not, write to the Free Software
 Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 */
 
+#include <pthread.h>
+#include <signal.h>
 #include <stdio.h>
-#include <sys/time.h>
-#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
 #include "sud.hpp"
+#include "sudshm.hpp"
 #include "io.hpp"
+#include "leds.hpp"
+#include "light.hpp"
+#include "logfile.hpp"
+#include "stream.hpp"
+#include "sampler.hpp"
+#include "recorder.hpp"
+#include "ProjectConfig.h"
+#ifdef HAVE_SQLITE
+#include "sqlite.hpp"
+#endif
 
 #define TIMEOUT 30
+#define READ_SLICE 1000
 
-SudData *readData(SudController *sud, unsigned char mode, unsigned char type) {
-    SudData *data;
-    struct timeval t0, t1;
-    gettimeofday(&t0, NULL);
-    do {
-        data = sud->readData();
-        gettimeofday(&t1, NULL);
-    } while ((t1.tv_sec - t0.tv_sec) < TIMEOUT && (data == NULL || data->mode != mode || data->type != type));
+static volatile sig_atomic_t stopRequested = 0;
 
-    if (data != NULL && (data->mode != mode || data->type != type)) {
-        data = NULL;
+static void onStopSignal(int)
+{
+    stopRequested = 1;
+}
+
+/*
+ * Waits for a frame of the given mode and type for up to budget seconds,
+ * reading into data and discarding any other frames. When a send function is
+ * given, the request is sent first and sent again whenever the reply is
+ * overdue according to the device latency. The extra replies to resent
+ * requests are discarded in the following exchanges. Reading exchanges are
+ * abandoned when a stop is requested, the goodbye still goes through.
+ */
+SudData *readData(SudController *sud, SudData *data, unsigned char mode, unsigned char type, double budget, int (SudController::*send)() = NULL) {
+    SudLatency *latency = sud->getLatency();
+    int sends = 1;
+    double sent = SudClock::now();
+    double end = sent + budget;
+
+    if (send != NULL) {
+        while (sud->readDataInto(data, 0) != NULL) {
+            latency->isStale(data);
+        }
+
+        if (!(sud->*send)()) {
+            return NULL;
+        }
     }
 
-    return data;
+    while (1) {
+        double now = SudClock::now();
+        if (now >= end || (stopRequested && mode == 0x00)) {
+            return NULL;
+        }
+
+        double until = end;
+        if (send != NULL) {
+            until = sent + latency->getTimeout() / 1000.0;
+            if (now >= until) {
+                if (!(sud->*send)()) {
+                    return NULL;
+                }
+                sent = now;
+                latency->backoff();
+                sends++;
+                continue;
+            }
+            if (until > end) {
+                until = end;
+            }
+        }
+
+        // Reads are sliced so that stop requests are noticed even when the
+        // HID backend doesn't return on signals.
+        int wait = (int)((until - now) * 1000) + 1;
+        if (sud->readDataInto(data, wait < READ_SLICE ? wait : READ_SLICE) == NULL) {
+            continue;
+        }
+
+        if (data->mode == mode && data->type == type) {
+            if (latency->isStale(data)) {
+                continue;
+            }
+
+            if (send != NULL && sends == 1) {
+                latency->update(data->received - sent);
+            }
+
+            if (sends > 1) {
+                latency->expectStale(mode, type, sends - 1, data->received + 2 * latency->getTimeout() / 1000.0);
+            }
+
+            return data;
+        }
+    }
 }
 
 int main(int argc, char *argv[])
@@ -46,12 +123,29 @@ int main(int argc, char *argv[])
     Options options;
     hid_device_info *device;
     SudController *sud = NULL;
+    SudData frame;
     SudData *data;
+    SudShmWriter shm;
+    LedScheduler leds;
+    StreamSender stream;
+    SampleScheduler sampler;
+    LogWriter log;
+    LightAccumulator light;
+#ifdef HAVE_SQLITE
+    SqliteSink sqlite;
+#endif
+    char serial[WIRE_MAX_NAME];
 
     if (!parseOpts(&options, argc, argv)) {
         return 1;
     }
 
+    if (options.adaptiveBounds != NULL && !sampler.configure(options.adaptiveBounds, options.adaptiveRates)) {
+        fprintf(stderr, "Invalid adaptive sampling parameters.\n");
+
+        return -1;
+    }
+
     if (options.commands != 1) {
         fprintf(stderr, "Missing command option.\n");
 
@@ -90,26 +184,27 @@ int main(int argc, char *argv[])
         return -1;
     }
 
-    if (options.debug) {
-        sud->setDebugCallback(debugSud);
-    }
+    recorderInit(options.dumpPath, options.debug ? debugSud : NULL);
+    sud->setDebugCallback(recorderFrame);
 
-    if (!sud->hello()) {
-        fprintf(stderr, "Error greeting device.\n");
+    if (options.shmName != NULL && !shm.open(options.shmName)) {
+        fprintf(stderr, "Unable to open shared memory segment.\n");
 
         return -1;
     }
 
-    data = readData(sud, 0x88, 0x01);
+    data = readData(sud, &frame, 0x88, 0x01, TIMEOUT, &SudController::hello);
 
     if (data == NULL) {
         fprintf(stderr, "Error establishing communication with device.\n");
+        recorderDump();
 
          return -1;
     }
 
     if (data->mode != 0x88 || data->type != 0x01) {
         fprintf(stderr, "Error establishing connection with device, wrong message.\n");
+        recorderDump();
 
         return -1;
     }
@@ -124,9 +219,16 @@ int main(int argc, char *argv[])
         printDeviceInfo(device, data);
     }
 
+    if (wcstombs(serial, device->serial_number, WIRE_MAX_NAME) >= WIRE_MAX_NAME) {
+        serial[0] = '\0';
+    }
+
+    SudController::freeDevices();
+    device = NULL;
+
     if (options.cmdSetLeds) {
         int res = sud->setLeds(options.leds);
-        if (res == 0) {
+        if (res) {
 
             return 0;
         } else {
@@ -136,17 +238,83 @@ int main(int argc, char *argv[])
         }
     }
 
+    if (options.ledSocket != NULL && !leds.open(options.ledSocket)) {
+        fprintf(stderr, "Unable to open Led control socket.\n");
+
+        return -1;
+    }
+
+    if (options.collector != NULL) {
+        if (!stream.open(options.collector, serial)) {
+            fprintf(stderr, "Invalid or unresolvable collector address.\n");
+
+            return -1;
+        }
+    }
+
+    // The sink threads start with the handled signals blocked, so handlers
+    // always run on this thread: recorder dumps read the ring written here and
+    // stop requests interrupt the waits of the reading loop.
+    sigset_t handled, saved;
+    sigemptyset(&handled);
+    sigaddset(&handled, SIGUSR1);
+    sigaddset(&handled, SIGTERM);
+    sigaddset(&handled, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &handled, &saved);
+
+    if (options.database != NULL) {
+#ifdef HAVE_SQLITE
+        if (!sqlite.open(options.database, serial)) {
+            fprintf(stderr, "Unable to open database.\n");
+
+            return -1;
+        }
+#else
+        fprintf(stderr, "SQLite support not available.\n");
+
+        return -1;
+#endif
+    }
+
+    if (options.logPath != NULL && !log.open(options.logPath, options.logRotation, options.logCompress, &options)) {
+        fprintf(stderr, "Unable to open log file.\n");
+
+        return -1;
+    }
+
+    pthread_sigmask(SIG_SETMASK, &saved, NULL);
+
+    light.setInterval(options.lightInterval);
+    if (options.fullReadings) {
+        // Readings are expected every wait time, plus up to the read budget.
+        double cadence = options.adaptiveBounds != NULL ? sampler.getMaxInterval() : options.waitTime;
+        if (cadence + TIMEOUT > LIGHT_MAX_GAP) {
+            light.setMaxGap(cadence + TIMEOUT);
+        }
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = onStopSignal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGTERM, &action, NULL);
+    sigaction(SIGINT, &action, NULL);
+
     int rows = 0;
 
-    while (1) { 
+    while (!stopRequested) {
         if (options.fullReadings) {
-            sud->request();
-            data = readData(sud, 0, 1);
+            data = readData(sud, &frame, 0, 1, TIMEOUT, &SudController::request);
         } else {
-            data = readData(sud, 0, 2);
+            data = readData(sud, &frame, 0, 2, TIMEOUT);
         }
         if (data == NULL) {
+            if (stopRequested) {
+                break;
+            }
+
             fprintf(stderr, "Error reading sensor values.\n");
+            recorderDump();
 
             if (!options.cmdContReading) {
                 return -1;
@@ -155,31 +323,94 @@ int main(int argc, char *argv[])
             continue;
         }
 
-        if (!options.machineReadable && (rows == 0 || (options.headerRows != 0 && rows % options.headerRows == 0))) {
-            printHeader();
+        double ts = options.useDevTs ? data->deviceTime : data->hostTime;
+
+        if (log.isOpen()) {
+            log.push(data);
+        } else {
+            if (!options.machineReadable && (rows == 0 || (options.headerRows != 0 && rows % options.headerRows == 0))) {
+                printHeader();
+            }
+            rows++;
+
+            printReading(data, &options);
+        }
+
+        if (options.measure) {
+            printMeasurement();
+            options.measure = false;
         }
-        rows++;
 
-        printReading(data, &options);
+        shm.publish(data);
+        stream.send(ts, data);
+        sampler.update(data);
+        if (options.lightInterval >= 0) {
+            int events = light.update(ts, data);
+            if (log.isOpen()) {
+                char line[READING_LINE_SIZE];
+                if (events & (LIGHT_TURNED_ON | LIGHT_TURNED_OFF)) {
+                    formatLightEvent(line, sizeof(line), ts, events & LIGHT_TURNED_ON, &options);
+                    log.pushLine(line);
+                }
+                if (events & LIGHT_SUMMARY) {
+                    formatLightSummary(line, sizeof(line), light.getSummary(), &options);
+                    log.pushLine(line);
+                }
+            } else {
+                if (events & (LIGHT_TURNED_ON | LIGHT_TURNED_OFF)) {
+                    printLightEvent(ts, events & LIGHT_TURNED_ON, &options);
+                }
+                if (events & LIGHT_SUMMARY) {
+                    printLightSummary(light.getSummary(), &options);
+                }
+            }
+        }
+#ifdef HAVE_SQLITE
+        sqlite.push(ts, data);
+#endif
 
         if (!options.cmdContReading) {
             break;
         }
 
+        leds.poll();
+        leds.flush(sud);
+
         if (options.fullReadings) {
-            sleep(options.waitTime);
+            double wait = options.adaptiveBounds != NULL ? sampler.getInterval() : options.waitTime;
+            double until = SudClock::now() + wait;
+
+            // Wake up for pending stream batches and connections while
+            // waiting.
+            do {
+                double wake = stream.nextFlush();
+                leds.wait(sud, wake > 0 && wake < until ? wake : until, stream.getConnectingFd());
+                stream.flush(false);
+            } while (!stopRequested && SudClock::now() < until);
         }
     }
 
-    sud->bye();
+    fflush(stdout);
+    stream.flush(true);
+    leds.close();
 
-    data = readData(sud, 0x77, 1);
+    data = readData(sud, &frame, 0x77, 1, sud->getLatency()->getTimeout() / 1000.0, &SudController::bye);
     if (!data || !data->success) {
         fprintf(stderr, "Error closing the communication with the device.\n");
+        recorderDump();
     }
 
     sud->close();
 
+    log.close();
+#ifdef HAVE_SQLITE
+    sqlite.close();
+#endif
+
+    if (stopRequested) {
+        recorderDump();
+    }
+
     SudController::exit();
 
     return 0;
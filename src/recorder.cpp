@@ -0,0 +1,276 @@
+/*
+SudMon - Seneye USB Device Monitor
+Copyright (C) 2018  Bernat Arlandis (berarma@hotmail.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <atomic>
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "recorder.hpp"
+
+typedef struct {
+    std::atomic<uint64_t> seq;
+    uint64_t time;
+    unsigned char direction;
+    unsigned char size;
+    unsigned char data[RECORDER_FRAME_SIZE];
+} Slot;
+
+typedef struct {
+    uint64_t time;
+    unsigned char direction;
+    unsigned char size;
+    unsigned char data[RECORDER_FRAME_SIZE];
+} Record;
+
+static Slot slots[RECORDER_FRAMES];
+static std::atomic<uint64_t> head(0);
+static std::atomic<uint64_t> dumped(0);
+static uint64_t dumpSeq = 0;
+static const char *dumpPath = NULL;
+static void (*nextCallback)(int direction, const unsigned char *buffer, size_t size) = NULL;
+
+static void onSignal(int) {
+    recorderDump();
+}
+
+static void onExit() {
+    if (dumpPath != NULL && dumped.load() != head.load()) {
+        recorderDump();
+    }
+}
+
+static void writeAll(int fd, const void *buffer, size_t size) {
+    const char *p = (const char *)buffer;
+    while (size > 0) {
+        ssize_t res = write(fd, p, size);
+        if (res <= 0) {
+            return;
+        }
+        p += res;
+        size -= res;
+    }
+}
+
+static char *formatNumber(char *p, uint64_t value, int digits) {
+    char tmp[20];
+    int n = 0;
+    do {
+        tmp[n++] = '0' + value % 10;
+        value /= 10;
+    } while (value > 0 || n < digits);
+    while (n > 0) {
+        *p++ = tmp[--n];
+    }
+
+    return p;
+}
+
+static bool formatDumpName(char *name, size_t size, uint64_t seq) {
+    size_t length = strlen(dumpPath);
+
+    if (length + 22 > size) {
+        return false;
+    }
+    memcpy(name, dumpPath, length);
+    name[length] = '.';
+    *formatNumber(name + length + 1, seq, 1) = '\0';
+
+    return true;
+}
+
+static int openDump() {
+    char name[PATH_MAX];
+
+    // Numbering goes on from earlier runs, only the last RECORDER_DUMPS
+    // dumps are kept.
+    dumpSeq++;
+    if (dumpSeq > RECORDER_DUMPS && formatDumpName(name, sizeof(name), dumpSeq - RECORDER_DUMPS)) {
+        unlink(name);
+    }
+    if (!formatDumpName(name, sizeof(name), dumpSeq)) {
+        return -1;
+    }
+
+    return open(name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+}
+
+static void findLastDump() {
+    char dir[PATH_MAX];
+    const char *base = strrchr(dumpPath, '/');
+    size_t length;
+    DIR *d;
+
+    if (base == NULL) {
+        strcpy(dir, ".");
+        base = dumpPath;
+    } else {
+        snprintf(dir, sizeof(dir), "%.*s", base == dumpPath ? 1 : (int)(base - dumpPath), dumpPath);
+        base++;
+    }
+    length = strlen(base);
+
+    if ((d = opendir(dir)) == NULL) {
+        return;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        const char *suffix = entry->d_name + length + 1;
+        if (strncmp(entry->d_name, base, length) != 0 || entry->d_name[length] != '.' || !isdigit(*suffix)) {
+            continue;
+        }
+        char *end;
+        uint64_t seq = strtoull(suffix, &end, 10);
+        if (*end == '\0' && seq > dumpSeq) {
+            dumpSeq = seq;
+        }
+    }
+    closedir(d);
+}
+
+static void writeHex(int fd, const Record *record) {
+    static const char digits[] = "0123456789ABCDEF";
+    char line[128];
+    char *p = line;
+
+    p = formatNumber(p, record->time / 1000000000, 1);
+    *p++ = '.';
+    p = formatNumber(p, record->time % 1000000000, 9);
+    memcpy(p, record->direction ? " IN\n" : " OUT\n", record->direction ? 4 : 5);
+    p += record->direction ? 4 : 5;
+    writeAll(fd, line, p - line);
+
+    for (size_t i = 0; i < record->size; i += 16) {
+        p = line;
+        *p++ = ' ';
+        for (size_t j = i; j < i + 16 && j < record->size; j++) {
+            *p++ = ' ';
+            *p++ = digits[record->data[j] >> 4];
+            *p++ = digits[record->data[j] & 0xf];
+        }
+        *p++ = '\n';
+        writeAll(fd, line, p - line);
+    }
+}
+
+void recorderInit(const char *path, void (*next)(int direction, const unsigned char *buffer, size_t size)) {
+    struct sigaction action;
+
+    dumpPath = path;
+    nextCallback = next;
+    if (dumpPath != NULL) {
+        findLastDump();
+    }
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = onSignal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGUSR1, &action, NULL);
+    atexit(onExit);
+}
+
+void recorderFrame(int direction, const unsigned char *buffer, size_t size) {
+    struct timespec ts;
+    uint64_t index = head.load(std::memory_order_relaxed);
+    Slot *slot = &slots[index % RECORDER_FRAMES];
+
+    if (size > RECORDER_FRAME_SIZE) {
+        size = RECORDER_FRAME_SIZE;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    slot->seq.store(0, std::memory_order_relaxed);
+    std::atomic_signal_fence(std::memory_order_release);
+    slot->time = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    slot->direction = direction;
+    slot->size = size;
+    memcpy(slot->data, buffer, size);
+    std::atomic_signal_fence(std::memory_order_release);
+    slot->seq.store(index + 1, std::memory_order_relaxed);
+    head.store(index + 1, std::memory_order_release);
+
+    if (nextCallback != NULL) {
+        nextCallback(direction, buffer, size);
+    }
+}
+
+/*
+ * Async-signal-safe, it only uses write() and open().
+ */
+void recorderDump() {
+    int fd = STDERR_FILENO;
+    uint64_t end = head.load(std::memory_order_acquire);
+    uint64_t start = end > RECORDER_FRAMES ? end - RECORDER_FRAMES : 0;
+
+    dumped.store(end);
+
+    if (dumpPath != NULL) {
+        fd = openDump();
+        if (fd < 0) {
+            writeAll(STDERR_FILENO, "Unable to write flight recorder dump.\n", 38);
+            return;
+        }
+        writeAll(fd, "SUDFR1\0\0", 8);
+    } else {
+        writeAll(fd, "\n * Flight recorder\n", 20);
+    }
+
+    for (uint64_t index = start; index < end; index++) {
+        const Slot *slot = &slots[index % RECORDER_FRAMES];
+        Record record;
+
+        if (slot->seq.load(std::memory_order_relaxed) != index + 1) {
+            continue;
+        }
+        std::atomic_signal_fence(std::memory_order_acquire);
+        record.time = slot->time;
+        record.direction = slot->direction;
+        record.size = slot->size;
+        memcpy(record.data, slot->data, RECORDER_FRAME_SIZE);
+        std::atomic_signal_fence(std::memory_order_acquire);
+        if (slot->seq.load(std::memory_order_relaxed) != index + 1) {
+            continue;
+        }
+
+        if (dumpPath != NULL) {
+            unsigned char packed[10 + RECORDER_FRAME_SIZE];
+            memcpy(packed, &record.time, 8);
+            packed[8] = record.direction;
+            packed[9] = record.size;
+            memcpy(packed + 10, record.data, RECORDER_FRAME_SIZE);
+            writeAll(fd, packed, sizeof(packed));
+        } else {
+            writeHex(fd, &record);
+        }
+    }
+
+    if (dumpPath != NULL) {
+        close(fd);
+    }
+}
@@ -0,0 +1,46 @@
+/*
+SudMon - Seneye USB Device Monitor
+Copyright (C) 2018  Bernat Arlandis (berarma@hotmail.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <stddef.h>
+
+#ifndef SUD_RECORDER_HPP
+#define SUD_RECORDER_HPP
+
+#ifndef RECORDER_FRAMES
+#define RECORDER_FRAMES 128
+#endif
+#ifndef RECORDER_DUMPS
+#define RECORDER_DUMPS 16
+#endif
+#define RECORDER_FRAME_SIZE 64
+
+/*
+ * Flight recorder keeping the last RECORDER_FRAMES frames exchanged with the
+ * device. Dumps go to stderr as hex or, when a path is set, in binary form to
+ * a new file named path.N with N increasing across runs, keeping the last
+ * RECORDER_DUMPS files. The binary dump is the 8 byte magic "SUDFR1\0\0"
+ * followed by records of a 64 bit monotonic time in nanoseconds, a direction
+ * byte (1 for IN, 0 for OUT), a size byte and RECORDER_FRAME_SIZE data bytes,
+ * all in host byte order.
+ */
+void recorderInit(const char *path, void (*next)(int direction, const unsigned char *buffer, size_t size));
+void recorderFrame(int direction, const unsigned char *buffer, size_t size);
+void recorderDump();
+
+#endif
@@ -0,0 +1,112 @@
+/*
+SudMon - Seneye USB Device Monitor
+Copyright (C) 2018  Bernat Arlandis (berarma@hotmail.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include "sampler.hpp"
+
+// One step of the sensor readings for temperature, pH and NH3.
+static const double resolution[3] = {0.001, 0.01, 0.001};
+
+SampleScheduler::SampleScheduler() : minInterval(0), maxInterval(0), interval(0), lastTime(0), hasLast(false)
+{
+    rates[0] = 0.05;
+    rates[1] = 0.02;
+    rates[2] = 0.005;
+}
+
+bool SampleScheduler::configure(const char *bounds, const char *rates)
+{
+    if (sscanf(bounds, "%lf,%lf", &minInterval, &maxInterval) != 2 || minInterval < 0 || maxInterval < minInterval) {
+        return false;
+    }
+
+    if (rates != NULL && sscanf(rates, "%lf,%lf,%lf", &this->rates[0], &this->rates[1], &this->rates[2]) != 3) {
+        return false;
+    }
+
+    interval = minInterval;
+
+    return true;
+}
+
+void SampleScheduler::update(const SudData *data)
+{
+    double values[3];
+    bool current[3];
+    bool active = data->stateT != 0 || data->statePh != 0 || data->stateNh3 != 0;
+    bool flat = true;
+
+    if (!data->fullReading) {
+        return;
+    }
+
+    values[0] = data->temp / 1000.0;
+    values[1] = data->ph / 100.0;
+    values[2] = data->nh3 / 1000.0;
+    current[0] = true;
+    current[1] = current[2] = !data->slideNotFitted;
+
+    if (hasLast && data->received > lastTime) {
+        double minutes = (data->received - lastTime) / 60;
+        for (int i = 0; i < 3; i++) {
+            if (!current[i] || !valid[i]) {
+                continue;
+            }
+            // A change of one step is flicker, not activity.
+            double change = fabs(values[i] - last[i]) - resolution[i];
+            double rate = change > 0 ? change / minutes : 0;
+            if (rate > rates[i]) {
+                active = true;
+            }
+            if (rate > rates[i] * SAMPLER_FLAT) {
+                flat = false;
+            }
+        }
+    }
+
+    if (active) {
+        interval = minInterval;
+    } else if (flat && hasLast) {
+        interval = interval * SAMPLER_GROWTH;
+        if (interval < 1) {
+            interval = 1;
+        }
+        if (interval > maxInterval) {
+            interval = maxInterval;
+        }
+    }
+
+    for (int i = 0; i < 3; i++) {
+        last[i] = values[i];
+        valid[i] = current[i];
+    }
+    lastTime = data->received;
+    hasLast = true;
+}
+
+double SampleScheduler::getInterval()
+{
+    return interval;
+}
+
+double SampleScheduler::getMaxInterval()
+{
+    return maxInterval;
+}
@@ -0,0 +1,54 @@
+/*
+SudMon - Seneye USB Device Monitor
+Copyright (C) 2018  Bernat Arlandis (berarma@hotmail.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "sud.hpp"
+
+#ifndef SUD_SAMPLER_HPP
+#define SUD_SAMPLER_HPP
+
+#define SAMPLER_GROWTH 1.5
+#define SAMPLER_FLAT 0.25
+
+/*
+ * Chooses the wait time before the next full reading. The interval drops to
+ * the minimum when temperature, pH or NH3 change faster than the given rates
+ * (units per minute) or any sensor state leaves normal, and grows towards the
+ * maximum while values stay flat. Changes of a single sensor step are
+ * ignored.
+ */
+class SampleScheduler
+{
+    double minInterval;
+    double maxInterval;
+    double interval;
+    double rates[3];
+    double last[3];
+    bool valid[3];
+    double lastTime;
+    bool hasLast;
+
+    public:
+        SampleScheduler();
+        bool configure(const char *bounds, const char *rates);
+        void update(const SudData *data);
+        double getInterval();
+        double getMaxInterval();
+};
+
+#endif
@@ -0,0 +1,239 @@
+/*
+SudMon - Seneye USB Device Monitor
+Copyright (C) 2018  Bernat Arlandis (berarma@hotmail.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sqlite.hpp"
+
+static const char *schema =
+    "CREATE TABLE IF NOT EXISTS readings ("
+    "device TEXT NOT NULL, "
+    "timestamp REAL NOT NULL, "
+    "full INTEGER NOT NULL, "
+    "in_water INTEGER, "
+    "slide_fitted INTEGER, "
+    "slide_expired INTEGER, "
+    "temp REAL, "
+    "ph REAL, "
+    "nh3 REAL, "
+    "state_t INTEGER, "
+    "state_ph INTEGER, "
+    "state_nh3 INTEGER, "
+    "kelvin INTEGER, "
+    "x INTEGER, "
+    "y INTEGER, "
+    "par INTEGER, "
+    "lux INTEGER, "
+    "pur INTEGER);"
+    "CREATE INDEX IF NOT EXISTS readings_device_timestamp ON readings (device, timestamp);";
+
+static const char *insertSql =
+    "INSERT INTO readings VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)";
+
+SqliteSink::SqliteSink() : db(NULL), insert(NULL), device(NULL), head(0), size(0), dropped(0), failed(0), stopping(false)
+{
+}
+
+SqliteSink::~SqliteSink()
+{
+    close();
+}
+
+bool SqliteSink::open(const char *path, const char *device)
+{
+    if (sqlite3_open(path, &db) != SQLITE_OK) {
+        sqlite3_close(db);
+        db = NULL;
+        return false;
+    }
+
+    sqlite3_busy_timeout(db, 1000);
+
+    if (!exec("PRAGMA journal_mode=WAL") || !exec("PRAGMA synchronous=NORMAL") || !exec(schema)
+            || sqlite3_prepare_v2(db, insertSql, -1, &insert, NULL) != SQLITE_OK) {
+        close();
+        return false;
+    }
+
+    this->device = strdup(device);
+    stopping = false;
+    worker = std::thread(&SqliteSink::run, this);
+
+    return true;
+}
+
+void SqliteSink::close()
+{
+    if (worker.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        ready.notify_one();
+        worker.join();
+    }
+
+    if (dropped > 0) {
+        fprintf(stderr, "SQLite queue full, %lu readings dropped.\n", dropped);
+        dropped = 0;
+    }
+
+    if (failed > 0) {
+        fprintf(stderr, "SQLite errors, %lu readings not stored.\n", failed);
+        failed = 0;
+    }
+
+    sqlite3_finalize(insert);
+    insert = NULL;
+    sqlite3_close(db);
+    db = NULL;
+    free(device);
+    device = NULL;
+}
+
+void SqliteSink::push(double time, const SudData *data)
+{
+    if (db == NULL || data->mode != 0x00) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (size == SQLITE_QUEUE) {
+            dropped++;
+            return;
+        }
+        Item *item = &queue[(head + size) % SQLITE_QUEUE];
+        item->time = time;
+        item->data = *data;
+        size++;
+    }
+    ready.notify_one();
+}
+
+void SqliteSink::run()
+{
+    Item batch[SQLITE_BATCH];
+    bool transaction = false;
+    int rows = 0;
+    int stored = 0;
+    double started = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (1) {
+        if (size == 0 && !stopping) {
+            if (transaction) {
+                double left = started + SQLITE_INTERVAL - SudClock::now();
+                if (left > 0) {
+                    ready.wait_for(lock, std::chrono::duration<double>(left));
+                }
+            } else {
+                ready.wait(lock);
+            }
+        }
+
+        size_t count = 0;
+        while (size > 0 && count < SQLITE_BATCH) {
+            batch[count++] = queue[head];
+            head = (head + 1) % SQLITE_QUEUE;
+            size--;
+        }
+        bool stop = stopping && size == 0;
+        lock.unlock();
+
+        for (size_t i = 0; i < count; i++) {
+            // Without a transaction the row is still stored on its own.
+            if (!transaction && exec("BEGIN")) {
+                transaction = true;
+                started = SudClock::now();
+                rows = stored = 0;
+            }
+            if (store(&batch[i])) {
+                stored++;
+            } else {
+                failed++;
+            }
+            rows++;
+            if (transaction && rows >= SQLITE_BATCH) {
+                commit(stored);
+                transaction = false;
+            }
+        }
+
+        if (transaction && (stop || SudClock::now() >= started + SQLITE_INTERVAL)) {
+            commit(stored);
+            transaction = false;
+        }
+
+        lock.lock();
+        if (stop) {
+            break;
+        }
+    }
+}
+
+void SqliteSink::commit(int stored)
+{
+    if (!exec("COMMIT")) {
+        exec("ROLLBACK");
+        failed += stored;
+    }
+}
+
+bool SqliteSink::store(const Item *item)
+{
+    const SudData *data = &item->data;
+    bool slide = data->fullReading && !data->slideNotFitted;
+
+    sqlite3_reset(insert);
+    sqlite3_clear_bindings(insert);
+    sqlite3_bind_text(insert, 1, device, -1, SQLITE_STATIC);
+    sqlite3_bind_double(insert, 2, item->time);
+    sqlite3_bind_int(insert, 3, data->fullReading);
+    if (data->fullReading) {
+        sqlite3_bind_int(insert, 4, data->inWater);
+        sqlite3_bind_int(insert, 5, !data->slideNotFitted);
+        sqlite3_bind_int(insert, 6, data->slideExpired);
+        sqlite3_bind_double(insert, 7, data->temp / 1000.0);
+        sqlite3_bind_int(insert, 10, data->stateT);
+        sqlite3_bind_int(insert, 11, data->statePh);
+        sqlite3_bind_int(insert, 12, data->stateNh3);
+    }
+    if (slide) {
+        sqlite3_bind_double(insert, 8, data->ph / 100.0);
+        sqlite3_bind_double(insert, 9, data->nh3 / 1000.0);
+    }
+    if (data->isKelvin) {
+        sqlite3_bind_int(insert, 13, data->kelvin / 1000);
+    }
+    sqlite3_bind_int(insert, 14, data->x);
+    sqlite3_bind_int(insert, 15, data->y);
+    sqlite3_bind_int64(insert, 16, data->par);
+    sqlite3_bind_int64(insert, 17, data->lux);
+    sqlite3_bind_int(insert, 18, data->pur);
+
+    return sqlite3_step(insert) == SQLITE_DONE;
+}
+
+bool SqliteSink::exec(const char *sql)
+{
+    return sqlite3_exec(db, sql, NULL, NULL, NULL) == SQLITE_OK;
+}
@@ -0,0 +1,77 @@
+/*
+SudMon - Seneye USB Device Monitor
+Copyright (C) 2018  Bernat Arlandis (berarma@hotmail.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "sud.hpp"
+
+#ifndef SUD_SQLITE_HPP
+#define SUD_SQLITE_HPP
+
+#ifndef SQLITE_QUEUE
+#define SQLITE_QUEUE 1024
+#endif
+#define SQLITE_BATCH 100
+#define SQLITE_INTERVAL 5.0
+
+struct sqlite3;
+struct sqlite3_stmt;
+
+/*
+ * Stores readings in an SQLite database from a background thread. Readings
+ * are queued without blocking, dropped when the queue is full, and inserted
+ * in transactions committed every SQLITE_BATCH rows or SQLITE_INTERVAL
+ * seconds. A transaction that fails to commit is rolled back.
+ */
+class SqliteSink
+{
+    typedef struct {
+        double time;
+        SudData data;
+    } Item;
+
+    sqlite3 *db;
+    sqlite3_stmt *insert;
+    char *device;
+    Item queue[SQLITE_QUEUE];
+    size_t head;
+    size_t size;
+    unsigned long dropped;
+    unsigned long failed;
+    bool stopping;
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::thread worker;
+
+    public:
+        SqliteSink();
+        ~SqliteSink();
+        bool open(const char *path, const char *device);
+        void close();
+        void push(double time, const SudData *data);
+
+    private:
+        void run();
+        bool store(const Item *item);
+        void commit(int stored);
+        bool exec(const char *sql);
+};
+
+#endif
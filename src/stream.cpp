@@ -0,0 +1,281 @@
+/*
+SudMon - Seneye USB Device Monitor
+Copyright (C) 2018  Bernat Arlandis (berarma@hotmail.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include "stream.hpp"
+
+StreamSender::StreamSender() : fd(-1), addresses(NULL), candidate(NULL), connecting(false), session(0), head(1), sent(0), acked(0), pendingSince(0), lastAttempt(0), inputSize(0)
+{
+}
+
+StreamSender::~StreamSender()
+{
+    close();
+}
+
+bool StreamSender::open(const char *address, const char *serial)
+{
+    const char *colon = strrchr(address, ':');
+    if (colon == NULL || colon == address || colon[1] == '\0') {
+        return false;
+    }
+
+    // Resolved once, so that the reading loop never blocks on the resolver.
+    char *host = strndup(address, colon - address);
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    int res = getaddrinfo(host, colon + 1, &hints, &addresses);
+    free(host);
+    if (res != 0) {
+        addresses = NULL;
+        return false;
+    }
+    candidate = addresses;
+
+    strncpy(this->serial, serial, WIRE_MAX_NAME - 1);
+    this->serial[WIRE_MAX_NAME - 1] = '\0';
+    if (gethostname(this->host, WIRE_MAX_NAME) != 0) {
+        strcpy(this->host, "unknown");
+    }
+    this->host[WIRE_MAX_NAME - 1] = '\0';
+
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    session = tv.tv_sec ^ (tv.tv_usec << 12) ^ getpid();
+
+    return true;
+}
+
+void StreamSender::close()
+{
+    disconnect();
+    if (addresses != NULL) {
+        freeaddrinfo(addresses);
+    }
+    addresses = NULL;
+    candidate = NULL;
+}
+
+void StreamSender::send(double time, const SudData *data)
+{
+    if (addresses == NULL || data->mode != 0x00) {
+        return;
+    }
+
+    if (sent + 1 == head) {
+        pendingSince = SudClock::now();
+    }
+
+    wireReading(spool[head % STREAM_SPOOL], head, time, data);
+    head++;
+
+    if (head - acked > STREAM_SPOOL) {
+        acked = head - STREAM_SPOOL;
+    }
+    if (sent < acked) {
+        sent = acked;
+    }
+
+    flush(false);
+}
+
+void StreamSender::flush(bool force)
+{
+    unsigned char buffer[STREAM_BATCH * WIRE_READING_SIZE];
+    double now = SudClock::now();
+
+    if (addresses == NULL) {
+        return;
+    }
+
+    if (fd >= 0 && !connecting) {
+        readAcks();
+    }
+
+    uint32_t pending = head - 1 - sent;
+    if (pending == 0 || (!force && pending < STREAM_BATCH && now - pendingSince < STREAM_DELAY)) {
+        return;
+    }
+
+    if (fd < 0) {
+        if (now - lastAttempt < STREAM_RETRY) {
+            return;
+        }
+        lastAttempt = now;
+        if (!connect()) {
+            return;
+        }
+    }
+
+    if (connecting && !finishConnect(force ? STREAM_TIMEOUT : 0)) {
+        return;
+    }
+
+    while (sent + 1 < head) {
+        size_t size = 0;
+        uint32_t seq = sent;
+        while (seq + 1 < head && size + WIRE_READING_SIZE <= sizeof(buffer)) {
+            seq++;
+            memcpy(buffer + size, spool[seq % STREAM_SPOOL], WIRE_READING_SIZE);
+            size += WIRE_READING_SIZE;
+        }
+
+        if (::send(fd, buffer, size, MSG_NOSIGNAL) != (ssize_t)size) {
+            disconnect();
+            return;
+        }
+        sent = seq;
+    }
+}
+
+double StreamSender::nextFlush() const
+{
+    uint32_t pending = head - 1 - sent;
+    if (addresses == NULL || pending == 0) {
+        return 0;
+    }
+
+    if (connecting) {
+        return lastAttempt + STREAM_TIMEOUT / 1000.0;
+    }
+
+    double when = pending < STREAM_BATCH ? pendingSince + STREAM_DELAY : pendingSince;
+    if (fd < 0 && lastAttempt + STREAM_RETRY > when) {
+        when = lastAttempt + STREAM_RETRY;
+    }
+
+    return when;
+}
+
+int StreamSender::getConnectingFd() const
+{
+    return connecting ? fd : -1;
+}
+
+bool StreamSender::connect()
+{
+    // Each attempt tries the next resolved address.
+    struct addrinfo *ai = candidate;
+    candidate = candidate->ai_next != NULL ? candidate->ai_next : addresses;
+
+    fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol);
+    if (fd < 0) {
+        return false;
+    }
+
+    if (::connect(fd, ai->ai_addr, ai->ai_addrlen) != 0 && errno != EINPROGRESS) {
+        disconnect();
+        return false;
+    }
+
+    connecting = true;
+
+    return true;
+}
+
+bool StreamSender::finishConnect(int timeout)
+{
+    int error = 0;
+    socklen_t len = sizeof(error);
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLOUT;
+
+    if (poll(&pfd, 1, timeout) != 1) {
+        if (timeout > 0 || SudClock::now() - lastAttempt >= STREAM_TIMEOUT / 1000.0) {
+            disconnect();
+        }
+        return false;
+    }
+
+    if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) != 0 || error != 0) {
+        disconnect();
+        return false;
+    }
+
+    connecting = false;
+
+    struct timeval tv;
+    tv.tv_sec = STREAM_TIMEOUT / 1000;
+    tv.tv_usec = (STREAM_TIMEOUT % 1000) * 1000;
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    unsigned char hello[WIRE_MAX_FRAME];
+    size_t size = wireHello(hello, session, host, serial);
+    if (::send(fd, hello, size, MSG_NOSIGNAL) != (ssize_t)size) {
+        disconnect();
+        return false;
+    }
+
+    inputSize = 0;
+    sent = acked;
+
+    return true;
+}
+
+void StreamSender::disconnect()
+{
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+    connecting = false;
+}
+
+void StreamSender::readAcks()
+{
+    WireMessage message;
+    ssize_t res;
+
+    while ((res = recv(fd, input + inputSize, sizeof(input) - inputSize, MSG_DONTWAIT)) != 0) {
+        if (res < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                disconnect();
+            }
+            return;
+        }
+
+        inputSize += res;
+        if (inputSize < sizeof(input)) {
+            continue;
+        }
+        inputSize = 0;
+
+        if (wireDecode(input, sizeof(input), &message) != WIRE_ACK_SIZE || message.type != WIRE_ACK) {
+            disconnect();
+            return;
+        }
+        if (message.seq > acked && message.seq < head) {
+            acked = message.seq;
+        }
+    }
+
+    disconnect();
+}
@@ -0,0 +1,79 @@
+/*
+SudMon - Seneye USB Device Monitor
+Copyright (C) 2018  Bernat Arlandis (berarma@hotmail.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <netdb.h>
+#include <stdint.h>
+#include "sud.hpp"
+#include "wire.hpp"
+
+#ifndef SUD_STREAM_HPP
+#define SUD_STREAM_HPP
+
+#ifndef STREAM_SPOOL
+#define STREAM_SPOOL 4096
+#endif
+#define STREAM_BATCH 16
+#define STREAM_DELAY 2.0
+#define STREAM_RETRY 5.0
+#define STREAM_TIMEOUT 1000
+
+/*
+ * Sends readings to a collector. Readings are kept in a spool until the
+ * collector acknowledges them, so they are sent again after reconnecting.
+ * When the spool is full the oldest readings are dropped. Readings are sent in
+ * batches, nextFlush() tells when the pending ones are due, or 0 if none are.
+ * Connections are made without blocking, the socket given by
+ * getConnectingFd() becomes writable when a connection attempt ends.
+ */
+class StreamSender
+{
+    int fd;
+    struct addrinfo *addresses;
+    struct addrinfo *candidate;
+    bool connecting;
+    char host[WIRE_MAX_NAME];
+    char serial[WIRE_MAX_NAME];
+    uint32_t session;
+    unsigned char spool[STREAM_SPOOL][WIRE_READING_SIZE];
+    uint32_t head;
+    uint32_t sent;
+    uint32_t acked;
+    double pendingSince;
+    double lastAttempt;
+    unsigned char input[WIRE_ACK_SIZE];
+    size_t inputSize;
+
+    public:
+        StreamSender();
+        ~StreamSender();
+        bool open(const char *address, const char *serial);
+        void close();
+        void send(double time, const SudData *data);
+        void flush(bool force);
+        double nextFlush() const;
+        int getConnectingFd() const;
+
+    private:
+        bool connect();
+        bool finishConnect(int timeout);
+        void disconnect();
+        void readAcks();
+};
+
+#endif
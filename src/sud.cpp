@@ -18,8 +18,10 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 */
 
 #include <hidapi/hidapi.h>
+#include <math.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
 #include "sud.hpp"
 
 #define VID 0x24f7
@@ -28,14 +30,189 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #define WORD16(buffer) ((buffer)[0] + ((buffer)[1] << 8))
 #define WORD32(buffer) (WORD16(buffer) + ((buffer)[2] << 16) + ((buffer)[3] << 24))
 
+// Clock model tuning: weight decay per sample, maximum accepted drift, the
+// residual (in seconds) beyond which a sample is an outlier and the number of
+// consecutive outliers after which the device clock is considered reset.
+#define CLOCK_FORGET 0.995
+#define CLOCK_MAX_DRIFT 0.001
+#define CLOCK_MAX_RESIDUAL 2.0
+#define CLOCK_OUTLIERS 3
+
+// Seconds between wall clock offset updates when there are no full readings.
+#define CLOCK_REFRESH 60.0
+
+// Reply timeout bounds in milliseconds.
+#define LATENCY_INITIAL 2000
+#define LATENCY_MIN 250
+#define LATENCY_MAX 10000
+
 hid_device_info *SudController::enumeration = NULL;
 
-int SudController::exit()
+SudLatency::SudLatency() : srtt(0), rttvar(0), measured(false), timeout(LATENCY_INITIAL), staleMode(0), staleType(0), stale(0), staleUntil(0)
 {
-    if (enumeration != NULL) {
-        hid_free_enumeration(enumeration);
+}
+
+void SudLatency::update(double rtt)
+{
+    // Smoothed round-trip time and variance as in RFC 6298.
+    if (!measured) {
+        srtt = rtt;
+        rttvar = rtt / 2;
+        measured = true;
+    } else {
+        rttvar = 0.75 * rttvar + 0.25 * fabs(srtt - rtt);
+        srtt = 0.875 * srtt + 0.125 * rtt;
+    }
+
+    // A valid sample also ends any back-off.
+    timeout = (int)((srtt + 4 * rttvar) * 1000);
+    if (timeout < LATENCY_MIN) {
+        timeout = LATENCY_MIN;
+    } else if (timeout > LATENCY_MAX) {
+        timeout = LATENCY_MAX;
+    }
+}
+
+int SudLatency::getTimeout() const
+{
+    return timeout;
+}
+
+void SudLatency::backoff()
+{
+    // Kept until the next sample (RFC 6298 5.5), so that slow devices aren't
+    // sent every request twice.
+    timeout = timeout * 2 > LATENCY_MAX ? LATENCY_MAX : timeout * 2;
+}
+
+void SudLatency::expectStale(unsigned char mode, unsigned char type, int count, double until)
+{
+    staleMode = mode;
+    staleType = type;
+    stale = count;
+    staleUntil = until;
+}
+
+bool SudLatency::isStale(const SudData *data)
+{
+    if (stale > 0 && data->mode == staleMode && data->type == staleType && data->received < staleUntil) {
+        stale--;
+        return true;
     }
 
+    return false;
+}
+
+double SudClock::now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+SudClock::SudClock()
+{
+    refreshHost(now(), true);
+    reset();
+}
+
+void SudClock::refreshHost(double local, bool force)
+{
+    // Follows steps of the wall clock, such as the first NTP sync on boards
+    // without RTC, at a low rate to keep a single clock call per frame.
+    if (!force && local - refreshed < CLOCK_REFRESH) {
+        return;
+    }
+    refreshed = local;
+
+    struct timespec real;
+    clock_gettime(CLOCK_REALTIME, &real);
+    hostOffset = real.tv_sec + real.tv_nsec / 1e9 - local;
+}
+
+void SudClock::reset()
+{
+    sw = sx = sy = sxx = sxy = 0;
+    rate = 1;
+    offset = 0;
+    outliers = 0;
+    synced = false;
+}
+
+void SudClock::update(double local, time_t device)
+{
+    // The device clock has one second resolution, take the middle of the
+    // interval as the observed value.
+    double y = device + 0.5;
+
+    // Isolated outliers, like a stale reply read long after it arrived, are
+    // ignored.
+    if (synced && fabs(y - toDevice(local)) > CLOCK_MAX_RESIDUAL) {
+        if (++outliers < CLOCK_OUTLIERS) {
+            return;
+        }
+        reset();
+    }
+    outliers = 0;
+
+    if (!synced) {
+        local0 = local;
+        device0 = y;
+        synced = true;
+    }
+
+    double x = local - local0;
+    y -= device0;
+
+    // Weighted least squares fit with exponential forgetting so that the
+    // model follows slow changes in drift.
+    sw = sw * CLOCK_FORGET + 1;
+    sx = sx * CLOCK_FORGET + x;
+    sy = sy * CLOCK_FORGET + y;
+    sxx = sxx * CLOCK_FORGET + x * x;
+    sxy = sxy * CLOCK_FORGET + x * y;
+
+    double den = sw * sxx - sx * sx;
+    if (den > 1e-9) {
+        rate = (sw * sxy - sx * sy) / den;
+        if (rate < 1 - CLOCK_MAX_DRIFT) {
+            rate = 1 - CLOCK_MAX_DRIFT;
+        } else if (rate > 1 + CLOCK_MAX_DRIFT) {
+            rate = 1 + CLOCK_MAX_DRIFT;
+        }
+    }
+    offset = (sy - rate * sx) / sw;
+}
+
+bool SudClock::isSynced() const
+{
+    return synced;
+}
+
+double SudClock::getRate() const
+{
+    return rate;
+}
+
+double SudClock::toHost(double local) const
+{
+    return local + hostOffset;
+}
+
+double SudClock::toDevice(double local) const
+{
+    if (!synced) {
+        return toHost(local);
+    }
+
+    return device0 + offset + rate * (local - local0);
+}
+
+int SudController::exit()
+{
+    freeDevices();
+
     return hid_exit();
 }
 
@@ -46,9 +223,7 @@ int SudController::init()
 
 hid_device_info *SudController::findDevices()
 {
-    if (enumeration != NULL) {
-        hid_free_enumeration(enumeration);
-    }
+    freeDevices();
 
     enumeration = hid_enumerate(VID, PID);
 
@@ -76,6 +251,14 @@ hid_device_info *SudController::getDeviceInfo(char *ident)
     return NULL;
 }
 
+void SudController::freeDevices()
+{
+    if (enumeration != NULL) {
+        hid_free_enumeration(enumeration);
+        enumeration = NULL;
+    }
+}
+
 SudController *SudController::open(char *ident)
 {
     hid_device *handle = hid_open_path(ident);
@@ -98,7 +281,7 @@ SudController::SudController(hid_device *handle) : handle(handle), callback(NULL
 
 int SudController::setNonblocking(int nonblock)
 {
-    return hid_set_nonblocking(handle, 1);
+    return hid_set_nonblocking(handle, nonblock);
 }
 
 void SudController::setDebugCallback(void (*callback)(int direction, const unsigned char *buffer, size_t size))
@@ -176,22 +359,37 @@ int SudController::setLeds(char *ledValues)
     return write((const unsigned char*)&buffer, 65) == 65;
 }
 
-SudData *SudController::readData()
+SudData *SudController::readData(int timeout)
+{
+    SudData *data = new SudData();
+
+    if (readDataInto(data, timeout) == NULL) {
+        delete data;
+        return NULL;
+    }
+
+    return data;
+}
+
+SudData *SudController::readDataInto(SudData *data, int timeout)
 {
     memset(buffer, 0x00, 65);
 
-    int res = hid_read_timeout(handle, buffer, 64, 5000);
+    int res = hid_read_timeout(handle, buffer, 64, timeout);
     if (res <= 0) {
         return NULL;
     }
 
+    double received = SudClock::now();
+
     if (callback != NULL) {
         callback(1, buffer, 64);
     }
 
-    SudData *data = new SudData();
+    memset(data, 0, sizeof(SudData));
     data->mode = buffer[0];
     data->type = buffer[1];
+    data->received = received;
 
     switch (data->mode) {
         case 0x00:
@@ -199,6 +397,7 @@ SudData *SudController::readData()
                 case 1:
                     readAllValues(data, &buffer[2]);
                     data->fullReading = true;
+                    clock.update(received, data->timestamp);
                     break;
                 case 2:
                     data->isKelvin = buffer[2] & 1;
@@ -230,6 +429,10 @@ SudData *SudController::readData()
             break;
     }
 
+    clock.refreshHost(received, data->fullReading);
+    data->hostTime = clock.toHost(received);
+    data->deviceTime = clock.toDevice(received);
+
     return data;
 }
 
@@ -238,6 +441,16 @@ const unsigned char *SudController::getRawData()
     return (const unsigned char *)&buffer;
 }
 
+const SudClock *SudController::getClock()
+{
+    return &clock;
+}
+
+SudLatency *SudController::getLatency()
+{
+    return &latency;
+}
+
 const char *SudController::getModelName(unsigned char deviceType)
 {
     const char *modelName;
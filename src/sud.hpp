@@ -26,6 +26,11 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 typedef struct {
     unsigned char mode;
     unsigned char type;
+
+    double received;
+    double hostTime;
+    double deviceTime;
+
     union {
         struct {
             unsigned char success;
@@ -63,11 +68,63 @@ typedef struct {
     };
 } SudData;
 
+class SudClock
+{
+    double hostOffset;
+    double refreshed;
+    double local0;
+    double device0;
+    double sw, sx, sy, sxx, sxy;
+    double rate;
+    double offset;
+    int outliers;
+    bool synced;
+
+    public:
+        static double now();
+
+        SudClock();
+        void reset();
+        void refreshHost(double local, bool force);
+        void update(double local, time_t device);
+        bool isSynced() const;
+        double getRate() const;
+        double toHost(double local) const;
+        double toDevice(double local) const;
+};
+
+/*
+ * Reply timeout of a device, with its back-off after resends, and the
+ * replies still owed to resent requests, which are discarded when they
+ * arrive late.
+ */
+class SudLatency
+{
+    double srtt;
+    double rttvar;
+    bool measured;
+    int timeout;
+    unsigned char staleMode;
+    unsigned char staleType;
+    int stale;
+    double staleUntil;
+
+    public:
+        SudLatency();
+        void update(double rtt);
+        int getTimeout() const;
+        void backoff();
+        void expectStale(unsigned char mode, unsigned char type, int count, double until);
+        bool isStale(const SudData *data);
+};
+
 class SudController
 {
     static hid_device_info *enumeration;
     hid_device *handle;
     unsigned char buffer[65];
+    SudClock clock;
+    SudLatency latency;
     void (*callback)(int direction, const unsigned char *buffer, size_t size);
 
     public:
@@ -75,6 +132,7 @@ class SudController
         static int exit();
         static hid_device_info *findDevices();
         static hid_device_info *getDeviceInfo(char *ident);
+        static void freeDevices();
         static SudController *open(char *path);
 
         SudController(hid_device *handle);
@@ -83,8 +141,11 @@ class SudController
         int hello();
         int bye();
         void close();
-        SudData *readData();
+        SudData *readData(int timeout = 5000);
+        SudData *readDataInto(SudData *data, int timeout = 5000);
         const unsigned char *getRawData();
+        const SudClock *getClock();
+        SudLatency *getLatency();
         int request();
         int setLeds(char *ledValues);
 
@@ -0,0 +1,210 @@
+/*
+SudMon - Seneye USB Device Monitor
+Copyright (C) 2018  Bernat Arlandis (berarma@hotmail.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <unistd.h>
+#include "sudasync.hpp"
+
+#define POLL_INTERVAL 1000
+
+SudExecutor::~SudExecutor()
+{
+    waiters.clear();
+    for (auto task : tasks) {
+        task.destroy();
+    }
+}
+
+void SudExecutor::spawn(SudTask<int> &&task)
+{
+    std::coroutine_handle<SudTask<int>::promise_type> handle = task.release();
+    tasks.push_back(handle);
+    ready.push_back(handle);
+}
+
+void SudExecutor::run()
+{
+    while (!tasks.empty()) {
+        bool progress = !ready.empty();
+
+        while (!ready.empty()) {
+            std::coroutine_handle<> handle = ready.front();
+            ready.pop_front();
+            handle.resume();
+        }
+
+        std::list<SudAsync *> polled;
+        for (Waiter *waiter : waiters) {
+            bool seen = false;
+            for (SudAsync *device : polled) {
+                seen = seen || device == waiter->device;
+            }
+            if (!seen) {
+                polled.push_back(waiter->device);
+            }
+        }
+        for (SudAsync *device : polled) {
+            int res;
+            while ((res = poll(device)) != SUD_POLL_NONE) {
+                progress = true;
+                if (res == SUD_POLL_MATCHED) {
+                    break;
+                }
+            }
+        }
+
+        progress = expire() || progress;
+
+        collect();
+
+        if (!progress) {
+            usleep(POLL_INTERVAL);
+        }
+    }
+}
+
+void SudExecutor::wait(Waiter *waiter)
+{
+    waiters.push_back(waiter);
+}
+
+int SudExecutor::poll(SudAsync *device)
+{
+    SudData *data = device->sud->readData(0);
+    if (data == NULL) {
+        return SUD_POLL_NONE;
+    }
+
+    for (auto it = waiters.begin(); it != waiters.end(); ++it) {
+        Waiter *waiter = *it;
+        if (waiter->device == device && waiter->mode == data->mode && waiter->type == data->type) {
+            waiter->result = data;
+            waiters.erase(it);
+            ready.push_back(waiter->handle);
+
+            return SUD_POLL_MATCHED;
+        }
+    }
+
+    delete data;
+
+    return SUD_POLL_DISCARDED;
+}
+
+bool SudExecutor::expire()
+{
+    bool expired = false;
+    double now = SudClock::now();
+
+    for (auto it = waiters.begin(); it != waiters.end();) {
+        Waiter *waiter = *it;
+        if (now >= waiter->deadline) {
+            waiter->result = NULL;
+            it = waiters.erase(it);
+            ready.push_back(waiter->handle);
+            expired = true;
+        } else {
+            ++it;
+        }
+    }
+
+    return expired;
+}
+
+void SudExecutor::collect()
+{
+    for (auto it = tasks.begin(); it != tasks.end();) {
+        if (it->done()) {
+            it->destroy();
+            it = tasks.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+SudAsync::FrameAwaiter::FrameAwaiter(SudAsync *device, unsigned char mode, unsigned char type, int timeout)
+{
+    waiter.device = device;
+    waiter.mode = mode;
+    waiter.type = type;
+    waiter.deadline = SudClock::now() + timeout / 1000.0;
+    waiter.result = NULL;
+}
+
+bool SudAsync::FrameAwaiter::await_ready()
+{
+    return false;
+}
+
+void SudAsync::FrameAwaiter::await_suspend(std::coroutine_handle<> handle)
+{
+    waiter.handle = handle;
+    waiter.device->executor->wait(&waiter);
+}
+
+SudData *SudAsync::FrameAwaiter::await_resume()
+{
+    return waiter.result;
+}
+
+SudAsync::SudAsync(SudController *sud, SudExecutor *executor) : sud(sud), executor(executor)
+{
+}
+
+SudController *SudAsync::getController()
+{
+    return sud;
+}
+
+SudAsync::FrameAwaiter SudAsync::frame(unsigned char mode, unsigned char type, int timeout)
+{
+    return FrameAwaiter(this, mode, type, timeout);
+}
+
+SudTask<SudData *> SudAsync::handshake(int timeout)
+{
+    if (!sud->hello()) {
+        co_return NULL;
+    }
+
+    co_return co_await frame(0x88, 0x01, timeout);
+}
+
+SudTask<SudData *> SudAsync::fullReading(int timeout)
+{
+    if (!sud->request()) {
+        co_return NULL;
+    }
+
+    co_return co_await frame(0x00, 0x01, timeout);
+}
+
+SudTask<SudData *> SudAsync::nextLm(int timeout)
+{
+    co_return co_await frame(0x00, 0x02, timeout);
+}
+
+SudTask<SudData *> SudAsync::goodbye(int timeout)
+{
+    if (!sud->bye()) {
+        co_return NULL;
+    }
+
+    co_return co_await frame(0x77, 0x01, timeout);
+}
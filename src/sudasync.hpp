@@ -0,0 +1,206 @@
+/*
+SudMon - Seneye USB Device Monitor
+Copyright (C) 2018  Bernat Arlandis (berarma@hotmail.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <coroutine>
+#include <exception>
+#include <list>
+#include "sud.hpp"
+
+#ifndef SUD_ASYNC_HPP
+#define SUD_ASYNC_HPP
+
+#define SUD_ASYNC_TIMEOUT 5000
+
+#define SUD_POLL_NONE 0
+#define SUD_POLL_DISCARDED 1
+#define SUD_POLL_MATCHED 2
+
+/*
+ * Lazily started coroutine returning a value of type T. Awaiting a task
+ * starts it and resumes the awaiting coroutine when it finishes.
+ */
+template<typename T>
+class SudTask
+{
+    public:
+        struct promise_type
+        {
+            T value;
+            std::coroutine_handle<> continuation;
+
+            SudTask get_return_object()
+            {
+                return SudTask(std::coroutine_handle<promise_type>::from_promise(*this));
+            }
+
+            std::suspend_always initial_suspend() noexcept
+            {
+                return {};
+            }
+
+            struct FinalAwaiter
+            {
+                bool await_ready() noexcept
+                {
+                    return false;
+                }
+
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept
+                {
+                    if (handle.promise().continuation) {
+                        return handle.promise().continuation;
+                    }
+                    return std::noop_coroutine();
+                }
+
+                void await_resume() noexcept
+                {
+                }
+            };
+
+            FinalAwaiter final_suspend() noexcept
+            {
+                return {};
+            }
+
+            void return_value(T value)
+            {
+                this->value = value;
+            }
+
+            void unhandled_exception()
+            {
+                std::terminate();
+            }
+        };
+
+        SudTask(SudTask &&other) : handle(other.handle)
+        {
+            other.handle = nullptr;
+        }
+
+        ~SudTask()
+        {
+            if (handle) {
+                handle.destroy();
+            }
+        }
+
+        bool await_ready()
+        {
+            return false;
+        }
+
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> continuation)
+        {
+            handle.promise().continuation = continuation;
+            return handle;
+        }
+
+        T await_resume()
+        {
+            return handle.promise().value;
+        }
+
+        std::coroutine_handle<promise_type> release()
+        {
+            std::coroutine_handle<promise_type> released = handle;
+            handle = nullptr;
+            return released;
+        }
+
+    private:
+        std::coroutine_handle<promise_type> handle;
+
+        explicit SudTask(std::coroutine_handle<promise_type> handle) : handle(handle)
+        {
+        }
+};
+
+class SudAsync;
+
+/*
+ * Single threaded executor. Polls every device with pending operations using
+ * non-blocking reads and resumes the coroutine waiting for each frame. A
+ * device isn't polled again until the resumed coroutine had the chance to
+ * wait for its next frame.
+ */
+class SudExecutor
+{
+    struct Waiter
+    {
+        SudAsync *device;
+        unsigned char mode;
+        unsigned char type;
+        double deadline;
+        SudData *result;
+        std::coroutine_handle<> handle;
+    };
+
+    std::list<Waiter *> waiters;
+    std::list<std::coroutine_handle<>> ready;
+    std::list<std::coroutine_handle<SudTask<int>::promise_type>> tasks;
+
+    public:
+        ~SudExecutor();
+        void spawn(SudTask<int> &&task);
+        void run();
+
+    private:
+        friend class SudAsync;
+
+        void wait(Waiter *waiter);
+        int poll(SudAsync *device);
+        bool expire();
+        void collect();
+};
+
+/*
+ * Awaitable interface to a device. Operations returning a SudData pointer
+ * yield NULL on timeout and transfer ownership of the data to the caller.
+ */
+class SudAsync
+{
+    friend class SudExecutor;
+
+    SudController *sud;
+    SudExecutor *executor;
+
+    public:
+        class FrameAwaiter
+        {
+            SudExecutor::Waiter waiter;
+
+            public:
+                FrameAwaiter(SudAsync *device, unsigned char mode, unsigned char type, int timeout);
+                bool await_ready();
+                void await_suspend(std::coroutine_handle<> handle);
+                SudData *await_resume();
+        };
+
+        SudAsync(SudController *sud, SudExecutor *executor);
+        SudController *getController();
+        FrameAwaiter frame(unsigned char mode, unsigned char type, int timeout = SUD_ASYNC_TIMEOUT);
+        SudTask<SudData *> handshake(int timeout = SUD_ASYNC_TIMEOUT);
+        SudTask<SudData *> fullReading(int timeout = SUD_ASYNC_TIMEOUT);
+        SudTask<SudData *> nextLm(int timeout = SUD_ASYNC_TIMEOUT);
+        SudTask<SudData *> goodbye(int timeout = SUD_ASYNC_TIMEOUT);
+};
+
+#endif
@@ -0,0 +1,200 @@
+/*
+SudMon - Seneye USB Device Monitor
+Copyright (C) 2018  Bernat Arlandis (berarma@hotmail.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <atomic>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "sud.hpp"
+
+#ifndef SUD_SHM_HPP
+#define SUD_SHM_HPP
+
+#define SUD_SHM_MAGIC 0x53554431
+#define SUD_SHM_VERSION 1
+
+/*
+ * Shared memory layout. The sequence counter is odd while the writer is
+ * updating the slots, readers retry until they see the same even value before
+ * and after copying.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;
+    std::atomic<uint32_t> sequence;
+    SudData full;
+    SudData latest;
+} SudShmSegment;
+
+class SudShmWriter
+{
+    SudShmSegment *segment;
+
+    public:
+        SudShmWriter() : segment(NULL)
+        {
+        }
+
+        ~SudShmWriter()
+        {
+            close();
+        }
+
+        bool open(const char *name)
+        {
+            int fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+            if (fd < 0) {
+                return false;
+            }
+
+            if (ftruncate(fd, sizeof(SudShmSegment)) != 0) {
+                ::close(fd);
+                return false;
+            }
+
+            void *addr = mmap(NULL, sizeof(SudShmSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if (addr == MAP_FAILED) {
+                return false;
+            }
+
+            segment = (SudShmSegment *)addr;
+            if (segment->magic != SUD_SHM_MAGIC || segment->version != SUD_SHM_VERSION || segment->size != sizeof(SudData)) {
+                memset((void *)segment, 0, sizeof(SudShmSegment));
+                segment->version = SUD_SHM_VERSION;
+                segment->size = sizeof(SudData);
+                std::atomic_thread_fence(std::memory_order_release);
+                segment->magic = SUD_SHM_MAGIC;
+            } else if (segment->sequence.load(std::memory_order_relaxed) & 1) {
+                // A previous writer died while updating.
+                segment->sequence.fetch_add(1, std::memory_order_release);
+            }
+
+            return true;
+        }
+
+        void close()
+        {
+            if (segment != NULL) {
+                munmap(segment, sizeof(SudShmSegment));
+                segment = NULL;
+            }
+        }
+
+        void publish(const SudData *data)
+        {
+            if (segment == NULL || data->mode != 0x00) {
+                return;
+            }
+
+            uint32_t sequence = segment->sequence.load(std::memory_order_relaxed);
+            segment->sequence.store(sequence + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            if (data->fullReading) {
+                memcpy(&segment->full, data, sizeof(SudData));
+            }
+            memcpy(&segment->latest, data, sizeof(SudData));
+            segment->sequence.store(sequence + 2, std::memory_order_release);
+        }
+};
+
+class SudShmReader
+{
+    const SudShmSegment *segment;
+
+    public:
+        SudShmReader() : segment(NULL)
+        {
+        }
+
+        ~SudShmReader()
+        {
+            close();
+        }
+
+        bool open(const char *name)
+        {
+            int fd = shm_open(name, O_RDONLY, 0);
+            if (fd < 0) {
+                return false;
+            }
+
+            struct stat st;
+            if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(SudShmSegment)) {
+                ::close(fd);
+                return false;
+            }
+
+            void *addr = mmap(NULL, sizeof(SudShmSegment), PROT_READ, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if (addr == MAP_FAILED) {
+                return false;
+            }
+
+            segment = (const SudShmSegment *)addr;
+            if (segment->magic != SUD_SHM_MAGIC || segment->version != SUD_SHM_VERSION || segment->size != sizeof(SudData)) {
+                close();
+                return false;
+            }
+
+            return true;
+        }
+
+        void close()
+        {
+            if (segment != NULL) {
+                munmap((void *)segment, sizeof(SudShmSegment));
+                segment = NULL;
+            }
+        }
+
+        /*
+         * Copies the latest full reading and the latest reading of any kind.
+         * Either pointer may be NULL. Slots never written have mode and type
+         * set to zero. Returns the sequence number of the snapshot, which
+         * only changes when new data is published.
+         */
+        uint32_t read(SudData *full, SudData *latest) const
+        {
+            uint32_t before, after;
+
+            do {
+                before = segment->sequence.load(std::memory_order_acquire);
+                if (before & 1) {
+                    continue;
+                }
+                if (full != NULL) {
+                    memcpy(full, &segment->full, sizeof(SudData));
+                }
+                if (latest != NULL) {
+                    memcpy(latest, &segment->latest, sizeof(SudData));
+                }
+                std::atomic_thread_fence(std::memory_order_acquire);
+                after = segment->sequence.load(std::memory_order_relaxed);
+            } while ((before & 1) || before != after);
+
+            return before;
+        }
+};
+
+#endif
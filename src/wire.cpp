@@ -0,0 +1,289 @@
+/*
+SudMon - Seneye USB Device Monitor
+Copyright (C) 2018  Bernat Arlandis (berarma@hotmail.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <math.h>
+#include <string.h>
+#include "wire.hpp"
+
+#define FLAG_FULL 0x01
+#define FLAG_IN_WATER 0x02
+#define FLAG_SLIDE_NOT_FITTED 0x04
+#define FLAG_SLIDE_EXPIRED 0x08
+#define FLAG_KELVIN 0x10
+#define FLAG_ERROR 0x20
+
+static unsigned char *put8(unsigned char *buffer, uint8_t value)
+{
+    buffer[0] = value;
+
+    return buffer + 1;
+}
+
+static unsigned char *put16(unsigned char *buffer, uint16_t value)
+{
+    buffer[0] = value & 0xff;
+    buffer[1] = value >> 8;
+
+    return buffer + 2;
+}
+
+static unsigned char *put32(unsigned char *buffer, uint32_t value)
+{
+    put16(buffer, value & 0xffff);
+    put16(buffer + 2, value >> 16);
+
+    return buffer + 4;
+}
+
+static unsigned char *put64(unsigned char *buffer, uint64_t value)
+{
+    put32(buffer, value & 0xffffffff);
+    put32(buffer + 4, value >> 32);
+
+    return buffer + 8;
+}
+
+static unsigned char *putString(unsigned char *buffer, const char *value)
+{
+    size_t length = strnlen(value, WIRE_MAX_NAME - 1);
+    buffer = put8(buffer, length);
+    memcpy(buffer, value, length);
+
+    return buffer + length;
+}
+
+static const unsigned char *get8(const unsigned char *buffer, uint8_t *value)
+{
+    *value = buffer[0];
+
+    return buffer + 1;
+}
+
+static const unsigned char *get16(const unsigned char *buffer, uint16_t *value)
+{
+    *value = buffer[0] | (buffer[1] << 8);
+
+    return buffer + 2;
+}
+
+static const unsigned char *get32(const unsigned char *buffer, uint32_t *value)
+{
+    uint16_t low, high;
+    get16(buffer, &low);
+    get16(buffer + 2, &high);
+    *value = low | ((uint32_t)high << 16);
+
+    return buffer + 4;
+}
+
+static const unsigned char *get64(const unsigned char *buffer, uint64_t *value)
+{
+    uint32_t low, high;
+    get32(buffer, &low);
+    get32(buffer + 4, &high);
+    *value = low | ((uint64_t)high << 32);
+
+    return buffer + 8;
+}
+
+static const unsigned char *getString(const unsigned char *buffer, const unsigned char *end, char *value)
+{
+    uint8_t length;
+
+    if (buffer >= end) {
+        return NULL;
+    }
+    buffer = get8(buffer, &length);
+    if (length >= WIRE_MAX_NAME || buffer + length > end) {
+        return NULL;
+    }
+    memcpy(value, buffer, length);
+    value[length] = '\0';
+
+    return buffer + length;
+}
+
+size_t wireHello(unsigned char *buffer, uint32_t session, const char *host, const char *serial)
+{
+    unsigned char *p = buffer + WIRE_HEADER_SIZE;
+    p = put8(p, WIRE_HELLO);
+    p = put32(p, session);
+    p = putString(p, host);
+    p = putString(p, serial);
+    put16(buffer, p - buffer - WIRE_HEADER_SIZE);
+
+    return p - buffer;
+}
+
+size_t wireReading(unsigned char *buffer, uint32_t seq, double time, const SudData *data)
+{
+    unsigned char flags = 0;
+    if (data->fullReading) {
+        flags |= FLAG_FULL;
+    }
+    if (data->inWater) {
+        flags |= FLAG_IN_WATER;
+    }
+    if (data->slideNotFitted) {
+        flags |= FLAG_SLIDE_NOT_FITTED;
+    }
+    if (data->slideExpired) {
+        flags |= FLAG_SLIDE_EXPIRED;
+    }
+    if (data->isKelvin) {
+        flags |= FLAG_KELVIN;
+    }
+    if (data->error) {
+        flags |= FLAG_ERROR;
+    }
+
+    unsigned char *p = buffer + WIRE_HEADER_SIZE;
+    p = put8(p, WIRE_READING);
+    p = put32(p, seq);
+    p = put64(p, (uint64_t)llround(time * 1000));
+    p = put8(p, flags);
+    p = put32(p, data->timestamp);
+    p = put32(p, data->temp);
+    p = put16(p, data->ph);
+    p = put16(p, data->nh3);
+    p = put8(p, data->stateT);
+    p = put8(p, data->statePh);
+    p = put8(p, data->stateNh3);
+    p = put32(p, data->kelvin);
+    p = put32(p, data->x);
+    p = put32(p, data->y);
+    p = put32(p, data->par);
+    p = put32(p, data->lux);
+    p = put8(p, data->pur);
+    put16(buffer, p - buffer - WIRE_HEADER_SIZE);
+
+    return p - buffer;
+}
+
+size_t wireAck(unsigned char *buffer, uint32_t seq)
+{
+    unsigned char *p = buffer + WIRE_HEADER_SIZE;
+    p = put8(p, WIRE_ACK);
+    p = put32(p, seq);
+    put16(buffer, p - buffer - WIRE_HEADER_SIZE);
+
+    return p - buffer;
+}
+
+/*
+ * Decodes the frame at the start of the buffer. Returns the size of the
+ * frame, 0 when more data is needed or -1 when the frame is invalid.
+ */
+int wireDecode(const unsigned char *buffer, size_t size, WireMessage *message)
+{
+    uint16_t length;
+
+    if (size < WIRE_HEADER_SIZE) {
+        return 0;
+    }
+    get16(buffer, &length);
+    if (length == 0 || length > WIRE_MAX_FRAME - WIRE_HEADER_SIZE) {
+        return -1;
+    }
+    if (size < (size_t)length + WIRE_HEADER_SIZE) {
+        return 0;
+    }
+
+    const unsigned char *p = buffer + WIRE_HEADER_SIZE;
+    const unsigned char *end = p + length;
+    p = get8(p, &message->type);
+
+    switch (message->type) {
+        case WIRE_HELLO:
+            if (end - p < 4) {
+                return -1;
+            }
+            p = get32(p, &message->session);
+            p = getString(p, end, message->host);
+            if (p == NULL) {
+                return -1;
+            }
+            p = getString(p, end, message->serial);
+            if (p == NULL) {
+                return -1;
+            }
+            break;
+        case WIRE_READING:
+            {
+                if (length + WIRE_HEADER_SIZE != WIRE_READING_SIZE) {
+                    return -1;
+                }
+
+                SudData *data = &message->data;
+                uint64_t time;
+                uint32_t value32;
+                uint8_t flags, value8;
+
+                memset(data, 0, sizeof(SudData));
+                p = get32(p, &message->seq);
+                p = get64(p, &time);
+                message->time = (int64_t)time / 1000.0;
+                p = get8(p, &flags);
+                p = get32(p, &value32);
+                data->timestamp = value32;
+                p = get32(p, &value32);
+                data->temp = (int32_t)value32;
+                p = get16(p, &data->ph);
+                p = get16(p, &data->nh3);
+                p = get8(p, &value8);
+                data->stateT = value8;
+                p = get8(p, &value8);
+                data->statePh = value8;
+                p = get8(p, &value8);
+                data->stateNh3 = value8;
+                p = get32(p, &value32);
+                data->kelvin = (int32_t)value32;
+                p = get32(p, &value32);
+                data->x = (int32_t)value32;
+                p = get32(p, &value32);
+                data->y = (int32_t)value32;
+                p = get32(p, &data->par);
+                p = get32(p, &data->lux);
+                p = get8(p, &value8);
+                data->pur = value8;
+
+                data->mode = 0x00;
+                data->fullReading = flags & FLAG_FULL;
+                data->type = data->fullReading ? 1 : 2;
+                data->inWater = flags & FLAG_IN_WATER;
+                data->slideNotFitted = flags & FLAG_SLIDE_NOT_FITTED;
+                data->slideExpired = flags & FLAG_SLIDE_EXPIRED;
+                data->isKelvin = flags & FLAG_KELVIN;
+                data->error = flags & FLAG_ERROR;
+                data->hostTime = message->time;
+                data->deviceTime = message->time;
+            }
+            break;
+        case WIRE_ACK:
+            if (length + WIRE_HEADER_SIZE != WIRE_ACK_SIZE) {
+                return -1;
+            }
+            p = get32(p, &message->seq);
+            break;
+        default:
+            return -1;
+    }
+
+    return length + WIRE_HEADER_SIZE;
+}
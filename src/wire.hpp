@@ -0,0 +1,56 @@
+/*
+SudMon - Seneye USB Device Monitor
+Copyright (C) 2018  Bernat Arlandis (berarma@hotmail.com)
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sud.hpp"
+
+#ifndef SUD_WIRE_HPP
+#define SUD_WIRE_HPP
+
+/*
+ * Network stream format. Every frame starts with a 16 bit little endian
+ * payload length followed by a one byte message type.
+ */
+#define WIRE_HELLO 1
+#define WIRE_READING 2
+#define WIRE_ACK 3
+
+#define WIRE_HEADER_SIZE 2
+#define WIRE_READING_SIZE 52
+#define WIRE_ACK_SIZE 7
+#define WIRE_MAX_FRAME 256
+#define WIRE_MAX_NAME 64
+
+typedef struct {
+    unsigned char type;
+    uint32_t session;
+    uint32_t seq;
+    double time;
+    char host[WIRE_MAX_NAME];
+    char serial[WIRE_MAX_NAME];
+    SudData data;
+} WireMessage;
+
+size_t wireHello(unsigned char *buffer, uint32_t session, const char *host, const char *serial);
+size_t wireReading(unsigned char *buffer, uint32_t seq, double time, const SudData *data);
+size_t wireAck(unsigned char *buffer, uint32_t seq);
+int wireDecode(const unsigned char *buffer, size_t size, WireMessage *message);
+
+#endif